@@ -0,0 +1,95 @@
+#include "field.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include <sys/mman.h>
+
+using namespace std;
+
+FluxField::FluxField(bool huge_pages): huge_pages(huge_pages) {}
+
+FluxField::FluxField(const FluxField& o): huge_pages(o.huge_pages), cells(o.cells) {
+    set_slots(o.slots);
+    for (int s=0;s<slots;s++) memcpy(buffers[s], o.buffers[s], cells*sizeof(float));
+}
+
+FluxField::FluxField(FluxField&& o) noexcept:
+    huge_pages(o.huge_pages), cells(o.cells), slots(o.slots) {
+    copy(o.buffers, o.buffers+max_slots, buffers);
+    o.cells = 0;
+    o.slots = 0;
+    fill(o.buffers, o.buffers+max_slots, nullptr);
+}
+
+FluxField& FluxField::operator=(FluxField o) noexcept {
+    std::swap(huge_pages, o.huge_pages);
+    std::swap(cells, o.cells);
+    std::swap(slots, o.slots);
+    std::swap(buffers, o.buffers);
+    return *this;
+}
+
+FluxField::~FluxField() {
+    release();
+}
+
+float* FluxField::allocate() const {
+    size_t bytes = (cells*sizeof(float)+alignment-1)/alignment*alignment;
+    size_t align = alignment;
+    const bool use_huge = huge_pages && bytes >= huge_page;
+    if (use_huge) {
+        align = huge_page;
+        bytes = (bytes+huge_page-1)/huge_page*huge_page;
+    }
+    float *b = static_cast<float*>(aligned_alloc(align, bytes));
+    if (!b) throw bad_alloc();
+#ifdef MADV_HUGEPAGE
+    if (use_huge) madvise(b, bytes, MADV_HUGEPAGE);
+#endif
+    memset(b, 0, bytes);
+    return b;
+}
+
+void FluxField::release() {
+    for (int s=0;s<max_slots;s++) {
+        free(buffers[s]);
+        buffers[s] = nullptr;
+    }
+    slots = 0;
+}
+
+void FluxField::resize(size_t n) {
+    if (n == cells) return;
+    release();
+    cells = n;
+}
+
+size_t FluxField::size() const {
+    return cells;
+}
+
+void FluxField::set_slots(int n) {
+    n = max(0, min(n, max_slots));
+    if (cells == 0) n = 0;
+    for (int s=slots;s<n;s++) buffers[s] = allocate();
+    for (int s=n;s<slots;s++) {
+        free(buffers[s]);
+        buffers[s] = nullptr;
+    }
+    slots = n;
+}
+
+float* FluxField::slot(int s) {
+    return buffers[s];
+}
+
+const float* FluxField::slot(int s) const {
+    return buffers[s];
+}
+
+void FluxField::swap(int a, int b) {
+    std::swap(buffers[a], buffers[b]);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+
+// Storage for flux fields : up to four equally sized float buffers ("slots")
+// that kernels write a generation into and swap rather than copying fields.
+// Slots are only allocated once a kernel asks for them, each starts on a
+// 64-byte boundary. With huge pages, slots of at least one huge page are
+// rounded to 2 MB pages and advised into transparent huge pages, smaller
+// ones would only waste memory.
+class FluxField {
+public:
+    constexpr const static size_t alignment = 64;
+    constexpr const static size_t huge_page = 2 << 20;
+    constexpr const static int max_slots = 4;
+
+    FluxField(bool huge_pages = false);
+    FluxField(const FluxField& o);
+    FluxField(FluxField&& o) noexcept;
+    FluxField& operator=(FluxField o) noexcept;
+    ~FluxField();
+
+    // Frees every slot when the number of cells changes
+    void resize(size_t cells);
+    size_t size() const;
+    // Allocates the first n slots, zeroed, and frees the ones after them.
+    // Slots already allocated keep their content.
+    void set_slots(int n);
+
+    float* slot(int s);
+    const float* slot(int s) const;
+    void swap(int a, int b);
+
+private:
+    float* allocate() const;
+    void release();
+
+    bool huge_pages;
+    size_t cells = 0;
+    int slots = 0;
+    float* buffers[max_slots] = {};
+};
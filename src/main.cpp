@@ -10,12 +10,16 @@
 #include <cmath>
 #include <numeric>
 #include <algorithm>
+#include <iomanip>
 #include <memory>
 #include <sstream>
 
 #include <ncurses.h>
 
+#include "pacing.h"
 #include "reactor.h"
+#include "recorder.h"
+#include "validation.h"
 
 using namespace std;
 
@@ -26,6 +30,12 @@ const int height = 65;
 
 int h,w;
 
+// simulated time is kept as a step count, summing dt would drift
+long sim_steps = 0;
+unique_ptr<Recorder> recorder;
+unique_ptr<Player> player;
+Pacer pacer(dt, dt);
+
 void window(int sx, int sy, int x, int y, string title, function<void(WINDOW*)> f) {
 
     if (w >= width && h >= height) {
@@ -129,6 +139,84 @@ bool sendCommand(Reactor &r, string command) {
         } else return false;
     }
     
+    if (name == "record") {
+        if (com.size() == 2 && com[1] == "stop") {
+            recorder.reset();
+            return true;
+        }
+        bool log_space = com.size() == 3 && com[1] == "log";
+        if (com.size() == 2 || log_space) {
+            recorder.reset();
+            recorder = make_unique<Recorder>(com.back(), log_space);
+            if (!recorder->is_open()) {
+                recorder.reset();
+                return false;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    if (name == "play" && com.size() == 2) {
+        if (com[1] == "stop") {
+            player.reset();
+            return true;
+        }
+        player = make_unique<Player>(com[1]);
+        if (!player->is_open() || !player->next()) {
+            player.reset();
+            return false;
+        }
+        return true;
+    }
+
+    if (name == "kernel" && com.size() == 2) {
+        if (com[1] == "reference") r.set_kernel(Reactor::Kernel::Reference);
+        else if (com[1] == "optimized") r.set_kernel(Reactor::Kernel::Optimized);
+        else if (com[1] == "threaded") r.set_kernel(Reactor::Kernel::Threaded);
+        else if (com[1] == "multires") r.set_kernel(Reactor::Kernel::MultiResolution);
+        else return false;
+        return true;
+    }
+
+    if (name == "mesh" && com.size() == 3) {
+        stringstream ss1(com[1]);
+        int refinement;
+        ss1 >> refinement;
+        if (!ss1) return false;
+        stringstream ss2(com[2]);
+        int coarsening;
+        ss2 >> coarsening;
+        if (!ss2) return false;
+        return r.set_mesh(refinement, coarsening);
+    }
+
+    if (name == "warp" && com.size() == 2) {
+        if (com[1] == "max") {
+            pacer.set_ratio(0);
+            return true;
+        }
+        stringstream ss(com[1]);
+        float ratio;
+        ss >> ratio;
+        if (!ss || ratio <= 0) return false;
+        pacer.set_ratio(ratio);
+        return true;
+    }
+
+    if (name == "adaptive" && com.size() == 2) {
+        if (com[1] == "off") {
+            r.set_tolerance(0);
+            return true;
+        }
+        stringstream ss(com[1]);
+        float tolerance;
+        ss >> tolerance;
+        if (!ss || tolerance <= 0) return false;
+        r.set_tolerance(tolerance);
+        return true;
+    }
+
     if (name == "scram") {
         if (com.size() == 1) {
             r.scram();
@@ -144,9 +232,44 @@ bool sendCommand(Reactor &r, string command) {
     return false;
 }
 
-int main() {
+// ./main validate [-v] [--max-flux x] [--mean-flux x] [--total-flux x] [--period x]
+int run_validation(int argc, char **argv) {
+    auto candidates = candidate_kernels();
+    bool verbose = false;
+    for (int i=2;i<argc;i++) {
+        string arg = argv[i];
+        if (arg == "-v") {
+            verbose = true;
+            continue;
+        }
+        if (i+1 >= argc) return 2;
+        stringstream ss(argv[++i]);
+        float v;
+        ss >> v;
+        if (!ss) return 2;
+        for (auto &c : candidates) {
+            if (arg == "--max-flux") c.tolerance.max_flux = v;
+            else if (arg == "--mean-flux") c.tolerance.mean_flux = v;
+            else if (arg == "--total-flux") c.tolerance.total_flux = v;
+            else if (arg == "--period") c.tolerance.period = v;
+            else return 2;
+        }
+    }
+    bool passed = validate_conservation(cout);
+    passed = validate_convergence(cout, transient_library(), dt) && passed;
+    passed = validate_threads(cout, transient_library(), dt) && passed;
+    passed = validate(cout, transient_library(), candidates, dt, verbose) && passed;
+    return passed?0:1;
+}
+
+int main(int argc, char **argv) {
+
+    if (argc > 1 && string(argv[1]) == "validate") return run_validation(argc, argv);
 
     Reactor reactor;
+    // the interactive reactor is the only one stepping, it can have the
+    // worker threads to itself
+    reactor.set_kernel(Reactor::Kernel::Threaded);
 
     initscr();
     cbreak();
@@ -200,12 +323,34 @@ int main() {
 
         } else {
 
+            Reactor &view = player?player->reactor:reactor;
+
             // overview
             window(56,16,0,0,"Overview", [&](WINDOW *win) {
                 stringstream ss;
                 ss << loop_time.count() << "ms";
 
                 mvwprintw(win, 2, 2, ss.str().c_str());
+
+                stringstream warp;
+                warp << "Warp ";
+                if (pacer.get_ratio() > 0) warp << pacer.get_ratio() << "x";
+                else warp << "max";
+                warp << ", achieved " << fixed << setprecision(2) << pacer.get_achieved() << "x";
+                if (pacer.get_lost() > 0) warp << ", " << setprecision(1) << pacer.get_lost() << "s lost";
+                mvwprintw(win, 3, 2, warp.str().c_str());
+                if (pacer.is_overrun()) {
+                    wattrset(win, COLOR_PAIR(1));
+                    wprintw(win, " OVERRUN");
+                    wattrset(win, A_NORMAL);
+                }
+                if (player) {
+                    mvwprintw(win, 4, 2, "Playback t=%.2fs", player->get_time());
+                } else if (recorder) {
+                    mvwprintw(win, 4, 2, "Recording %d frames, %d dropped, %lu kB",
+                        recorder->get_frames(), recorder->get_dropped(),
+                        (unsigned long)(recorder->get_bytes()/1024));
+                }
             });
 
             window(56,30,0,16,"Rod positions", [&](WINDOW *win) {
@@ -227,7 +372,7 @@ int main() {
 
                 for (int i=4;i<Reactor::reactor_width-4;i++) {
                     for (int j=4;j<Reactor::reactor_width-4;j++) {
-                        auto &r = reactor.rods[i][j];
+                        auto &r = view.rods[i][j];
                         if (r.type != Reactor::RodType::Fuel && r.type != Reactor::RodType::None) {
                             int ii = (r.pos_z-r.min_pos_z)*100.0/(r.max_pos_z-r.min_pos_z);
                             if (!r.direction) ii = 100-ii;
@@ -242,13 +387,76 @@ int main() {
             });
 
             window(56,10,0,46, "Reactivity monitoring", [&](WINDOW *win) {
-                mvwprintw(win, 2, 2, "Neutron flux : %g", reactor.get_neutron_flux());
-                float period = reactor.get_period();
+                mvwprintw(win, 2, 2, "Neutron flux : %g", view.get_neutron_flux());
+                float period = view.get_period();
                 stringstream ss;
                 if (abs(period)>1000) ss << "***";
                 else ss << (int)period << "s";
                 mvwprintw(win, 3, 2, "Reactor period : %s", ss.str().c_str());
-                mvwprintw(win, 4, 2, "Radial peak : %g", reactor.get_radial_peak());
+                mvwprintw(win, 4, 2, "Radial peak : %g", view.get_radial_peak());
+                mvwprintw(win, 5, 2, "Axial peak : %g", view.get_axial_peak());
+                if (!player) {
+                    mvwprintw(win, 6, 2, "Sweeps : %d/%d, largest step %d",
+                        reactor.get_sweeps(), reactor.get_generations(), reactor.get_largest_substep());
+                }
+            });
+
+            window(56,9,0,56, "Axial flux", [&](WINDOW *win) {
+                // bottom of the core on the left, two levels per row
+                const int rows = 5;
+                float peak = 0;
+                for (int k=0;k<Reactor::axial_sections;k++) peak = max(peak, view.get_axial_flux(k));
+                if (peak <= 0) return;
+                for (int k=0;k<Reactor::axial_sections;k++) {
+                    int level = round(view.get_axial_flux(k)/peak*rows*2);
+                    for (int r=0;r<rows;r++) {
+                        int fill = level-(rows-1-r)*2;
+                        if (fill >= 2) mvwprintw(win, 2+r, 12+k, "#");
+                        else if (fill == 1) mvwprintw(win, 2+r, 12+k, ".");
+                    }
+                }
+                mvwprintw(win, 1+rows, 3, "bottom");
+                mvwprintw(win, 1+rows, 13+Reactor::axial_sections, "top");
+            });
+
+            window(100,52,56,0, "Flux map", [&](WINDOW *win) {
+                const string shades = " .:-=+*#%@";
+                float peak = 0;
+                for (int i=0;i<Reactor::core_width;i++) {
+                    for (int j=0;j<Reactor::core_width;j++) {
+                        peak = max(peak, view.get_channel_flux(i, j));
+                    }
+                }
+                if (peak <= 0) return;
+                for (int i=0;i<Reactor::core_width;i++) {
+                    for (int j=0;j<Reactor::core_width;j++) {
+                        float f = view.get_channel_flux(i, j);
+                        if (f <= 0) continue;
+                        int s = min((int)shades.size()-1, 1+(int)(f/peak*(shades.size()-1)));
+                        string txt(2, shades[s]);
+                        mvwprintw(win, 2+j, 2+i*2, txt.c_str());
+                    }
+                }
+            });
+
+            window(100,13,56,52, "Group flux", [&](WINDOW *win) {
+                // relative to the average channel
+                float sum = 0;
+                int channels = 0;
+                for (int i=0;i<Reactor::core_width;i++) {
+                    for (int j=0;j<Reactor::core_width;j++) {
+                        float f = view.get_channel_flux(i, j);
+                        if (f > 0) {
+                            sum += f;
+                            channels++;
+                        }
+                    }
+                }
+                for (int g=1;g<=view.get_group_count();g++) {
+                    float f = view.get_group_flux(g);
+                    mvwprintw(win, 1+g, 2, "Group %d : %g", g, f);
+                    if (sum > 0) mvwprintw(win, 1+g, 30, "x%.2f", f*channels/sum);
+                }
             });
 
             // warnings
@@ -264,12 +472,25 @@ int main() {
             });
         }
 
-        reactor.step(dt);
+        // as many steps as the warp ratio asks for
+        pacer.run([&]() {
+            if (player) {
+                // live simulation is paused during playback, frames are
+                // shown at the pace they were recorded
+                if (player->advance(dt)) return true;
+                player.reset();
+                return false;
+            }
+            reactor.step(dt);
+            sim_steps++;
+            if (recorder) recorder->push(reactor, (float)(sim_steps*(double)dt));
+            return true;
+        });
         auto end = chrono::steady_clock::now();
 
         loop_time = chrono::duration_cast<chrono::milliseconds>(end-start);
 
-        this_thread::sleep_for(chrono::milliseconds((int)(dt*1000))-loop_time);
+        pacer.wait();
         clock++;
     }
 }
\ No newline at end of file
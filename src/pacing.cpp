@@ -0,0 +1,96 @@
+#include "pacing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+using namespace std;
+
+using seconds = chrono::duration<double>;
+
+Pacer::Pacer(float step_time, float frame_time):
+    step_time(step_time),
+    frame(chrono::duration_cast<clock::duration>(seconds(frame_time))) {
+    auto now = clock::now();
+    restart(now);
+    next_frame = now;
+    window_start = now;
+}
+
+void Pacer::restart(clock::time_point now) {
+    origin = now;
+    origin_steps = steps;
+}
+
+void Pacer::set_ratio(float r) {
+    ratio = max(r, 0.f);
+    restart(clock::now());
+}
+
+float Pacer::get_ratio() const {
+    return ratio;
+}
+
+void Pacer::run(const function<bool()>& step) {
+    auto now = clock::now();
+    // leave part of the frame to input and display
+    auto deadline = now+frame*3/4;
+
+    long target = steps;
+    if (ratio > 0) {
+        double elapsed = seconds(now-origin).count();
+        target = origin_steps+(long)floor(elapsed*ratio/step_time);
+    }
+
+    while (ratio == 0 || steps < target) {
+        if (!step()) {
+            // nothing left to run, start over from here
+            target = steps;
+            restart(now);
+            break;
+        }
+        steps++;
+        if (clock::now() >= deadline) break;
+    }
+
+    if (ratio > 0) {
+        long debt = target-steps;
+        overrun = debt > 0;
+        // hopelessly behind, give up the debt rather than spiral
+        long max_debt = (long)ceil(max_lag*ratio/step_time);
+        if (debt > max_debt) {
+            lost_steps += debt;
+            restart(now);
+        }
+    } else {
+        overrun = false;
+    }
+
+    now = clock::now();
+    double window = seconds(now-window_start).count();
+    if (window >= achieved_window) {
+        achieved = (steps-window_steps)*step_time/window;
+        window_start = now;
+        window_steps = steps;
+    }
+}
+
+void Pacer::wait() {
+    next_frame += frame;
+    auto now = clock::now();
+    // frames are dropped, not bunched up, once the display falls behind
+    if (next_frame < now-frame) next_frame = now;
+    this_thread::sleep_until(next_frame);
+}
+
+float Pacer::get_achieved() const {
+    return achieved;
+}
+
+bool Pacer::is_overrun() const {
+    return overrun;
+}
+
+float Pacer::get_lost() const {
+    return lost_steps*step_time;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+
+// Keeps simulated time in step with the wall clock at a requested ratio.
+// The step budget of a frame is derived from the wall time elapsed since the
+// ratio was set, not from the previous frame, so late frames are caught up
+// by the following ones instead of drifting. Steps stop once the frame runs
+// out of time; the simulation only gives up time when it falls more than
+// max_lag behind.
+class Pacer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    Pacer(float step_time, float frame_time);
+
+    // Simulated seconds per wall second, 0 runs as fast as possible
+    void set_ratio(float ratio);
+    float get_ratio() const;
+
+    // Runs step() as many times as the frame allows, stops early when it
+    // returns false
+    void run(const std::function<bool()>& step);
+    // Sleeps until the next frame is due
+    void wait();
+
+    // Simulated seconds per wall second, averaged over the last half second
+    float get_achieved() const;
+    // True while the steps cannot keep up with the requested ratio
+    bool is_overrun() const;
+    // Simulated seconds given up so far
+    float get_lost() const;
+
+private:
+    constexpr const static float max_lag = 1; // wall seconds
+    constexpr const static float achieved_window = 0.5;
+
+    void restart(clock::time_point now);
+
+    const float step_time;
+    const clock::duration frame;
+    float ratio = 1;
+
+    clock::time_point origin;
+    long origin_steps = 0;
+    long steps = 0;
+    clock::time_point next_frame;
+
+    bool overrun = false;
+    long lost_steps = 0;
+
+    clock::time_point window_start;
+    long window_steps = 0;
+    float achieved = 0;
+};
@@ -0,0 +1,117 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+class ThreadPool {
+public:
+    ThreadPool() {
+        resize(thread::hardware_concurrency());
+    }
+
+    ~ThreadPool() {
+        resize(1);
+    }
+
+    void resize(int n) {
+        lock_guard<mutex> call(call_mutex);
+        n = max(1, n);
+        {
+            lock_guard<mutex> lock(job_mutex);
+            quit = true;
+        }
+        job_cv.notify_all();
+        for (auto &t : workers) t.join();
+        workers.clear();
+        quit = false;
+        count = n;
+        for (int i=1;i<n;i++) workers.emplace_back(&ThreadPool::run, this, i, generation);
+    }
+
+    int size() {
+        lock_guard<mutex> call(call_mutex);
+        return count;
+    }
+
+    void execute(int n, const function<void(int,int)>& f) {
+        lock_guard<mutex> call(call_mutex);
+        if (count == 1 || n <= 1) {
+            f(0, n);
+            return;
+        }
+        {
+            lock_guard<mutex> lock(job_mutex);
+            job = &f;
+            job_size = n;
+            pending = count-1;
+            generation++;
+        }
+        job_cv.notify_all();
+        run_chunk(0, n, f);
+        unique_lock<mutex> lock(job_mutex);
+        done_cv.wait(lock, [&]{return pending == 0;});
+        job = nullptr;
+    }
+
+private:
+    void run_chunk(int chunk, int n, const function<void(int,int)>& f) {
+        int begin = (long)n*chunk/count;
+        int end = (long)n*(chunk+1)/count;
+        if (begin < end) f(begin, end);
+    }
+
+    void run(int chunk, unsigned seen) {
+        while (true) {
+            const function<void(int,int)>* f;
+            int n;
+            {
+                unique_lock<mutex> lock(job_mutex);
+                job_cv.wait(lock, [&]{return quit || generation != seen;});
+                if (quit) return;
+                seen = generation;
+                f = job;
+                n = job_size;
+            }
+            run_chunk(chunk, n, *f);
+            {
+                lock_guard<mutex> lock(job_mutex);
+                pending--;
+            }
+            done_cv.notify_one();
+        }
+    }
+
+    mutex call_mutex;
+    mutex job_mutex;
+    condition_variable job_cv;
+    condition_variable done_cv;
+    vector<thread> workers;
+    int count = 1;
+    bool quit = false;
+    unsigned generation = 0;
+    const function<void(int,int)>* job = nullptr;
+    int job_size = 0;
+    int pending = 0;
+};
+
+static ThreadPool& pool() {
+    static ThreadPool p;
+    return p;
+}
+
+void parallel_for(int n, const function<void(int,int)>& f) {
+    pool().execute(n, f);
+}
+
+void set_thread_count(int n) {
+    pool().resize(n);
+}
+
+int get_thread_count() {
+    return pool().size();
+}
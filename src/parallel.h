@@ -0,0 +1,13 @@
+#pragma once
+
+#include <functional>
+
+// Runs f(begin, end) over [0, n) split into one contiguous chunk per thread,
+// on a shared pool of workers. The calling thread takes the first chunk and
+// the call returns once every chunk is done. Chunk boundaries only depend on
+// n and the thread count, so per-chunk results can be combined in order.
+void parallel_for(int n, const std::function<void(int,int)>& f);
+
+// Defaults to the hardware concurrency
+void set_thread_count(int n);
+int get_thread_count();
@@ -1,4 +1,5 @@
 #include "reactor.h"
+#include "parallel.h"
 
 #include <iostream>
 #include <map>
@@ -12,48 +13,93 @@
 #include <cmath>
 #include <numeric>
 #include <algorithm>
+#include <iterator>
+#include <limits>
 
 using namespace std;
 
-const float graphite_width = 0.25;
-const float reactor_height = Reactor::axial_sections*graphite_width;
-const float graphite_holes_diameter = 0.114;
-const float pressure_tube_inner_diameter = 0.08;
-const float rod_diameter = 0.06;
-const float pressure_tube_walls_thickness = 0.004;
-const float absorber_length = 5.12;
-const float short_absorber_length = 3.05;
-const float tip_gap = 1.25;
-const float tip_length = 4.5;
-const float rod_insert_speed = 0.4;
-const float rod_scram_speed = 0.4;
-const float source_strength = 1E-10;
-const float enrichment = 2E-2;
-const float u235_neutrons = 2.43;
+constexpr float graphite_width = 0.25;
+constexpr float reactor_height = Reactor::axial_sections*graphite_width;
+constexpr float graphite_holes_diameter = 0.114;
+constexpr float pressure_tube_inner_diameter = 0.08;
+constexpr float rod_diameter = 0.06;
+constexpr float pressure_tube_walls_thickness = 0.004;
+constexpr float absorber_length = 5.12;
+constexpr float short_absorber_length = 3.05;
+constexpr float tip_gap = 1.25;
+constexpr float tip_length = 4.5;
+constexpr float rod_insert_speed = 0.4;
+constexpr float rod_scram_speed = 0.4;
+constexpr float source_strength = 1E-10;
+constexpr float enrichment = 2E-2;
+constexpr float u235_neutrons = 2.43;
+constexpr float prompt_gen_time = 0.002;
 
 // volume occupied by material in section
-const float rr_graphite_volume = graphite_width*graphite_width*graphite_width;
-const float rrc_coolant_volume = graphite_width*M_PI*pressure_tube_inner_diameter*pressure_tube_inner_diameter/4;
-const float graphite_volume = (graphite_width*graphite_width-M_PI*graphite_holes_diameter*graphite_holes_diameter/4)*graphite_width;
-const float b4c_volume = graphite_width*M_PI*rod_diameter*rod_diameter/4;
-const float u_volume = 3.734E-4;
+constexpr float rr_graphite_volume = graphite_width*graphite_width*graphite_width;
+constexpr float rrc_coolant_volume = graphite_width*M_PI*pressure_tube_inner_diameter*pressure_tube_inner_diameter/4;
+constexpr float graphite_volume = (graphite_width*graphite_width-M_PI*graphite_holes_diameter*graphite_holes_diameter/4)*graphite_width;
+constexpr float b4c_volume = graphite_width*M_PI*rod_diameter*rod_diameter/4;
+constexpr float u_volume = 3.734E-4;
 
-const float coolant_volume = graphite_width*M_PI*(pressure_tube_inner_diameter*pressure_tube_inner_diameter-rod_diameter*rod_diameter)/4;
+constexpr float coolant_volume = graphite_width*M_PI*(pressure_tube_inner_diameter*pressure_tube_inner_diameter-rod_diameter*rod_diameter)/4;
 
 // macroscopic cross sections (m-1)
-const float graphite_abs_mcs = 2.26E-2;
-const float b4c_abs_mcs = 8.43E3;
-const float u235_fission_mcs = 1.425E3;
-const float u235_abs_mcs = 2.421E2;
-const float u238_abs_mcs = 4.89;
-const float water_abs_mcs = 1.338;
+constexpr float graphite_abs_mcs = 2.26E-2;
+constexpr float b4c_abs_mcs = 8.43E3;
+constexpr float u235_fission_mcs = 1.425E3;
+constexpr float u235_abs_mcs = 2.421E2;
+constexpr float u238_abs_mcs = 4.89;
+constexpr float water_abs_mcs = 1.338;
 
-Reactor::Reactor() {
-    // layouts
+namespace {
+
+constexpr Reactor::Rod make_rod(Reactor::RodType type) {
+    using RodType = Reactor::RodType;
+
+    Reactor::Rod r;
+    r.type = type;
+    if (type == RodType::Source) {
+        r.min_pos_z = -7;
+        r.max_pos_z = 0.5;
+        r.direction = true;
+        r.pos_z = r.min_pos_z;
+    } else if (type == RodType::Manual || type == RodType::Automatic) {
+        r.min_pos_z = -absorber_length+0.5;
+        r.max_pos_z = 0.5;
+        r.direction = true;
+        r.pos_z = r.max_pos_z;
+    } else if (type == RodType::Short) {
+        r.min_pos_z = reactor_height-short_absorber_length-0.5;
+        r.max_pos_z = reactor_height-0.5;
+        r.direction = false;
+        r.pos_z = r.min_pos_z;
+    } else if (type == RodType::Fuel) {
+        r.min_pos_z = 0;
+        r.max_pos_z = 0;
+        r.direction = true;
+        r.pos_z = 0;
+    }
+    r.target_z = r.pos_z;
+    return r;
+}
+
+// Graphite stack and initial rods, identical for every reactor
+struct CoreLayout {
+    Reactor::ColumnType columns[Reactor::reactor_width][Reactor::reactor_width] = {};
+    Reactor::Rod rods[Reactor::reactor_width][Reactor::reactor_width];
+};
+
+constexpr CoreLayout make_layout() {
+    using ColumnType = Reactor::ColumnType;
+    using RodType = Reactor::RodType;
+    const int reactor_width = Reactor::reactor_width;
+
+    CoreLayout l;
 
     // 2-bit alignment
     // 0 = None, 1 = RRC, 2 = RR, 3 = FC_CPS
-    const uint32_t layout[] = {
+    const uint32_t stack_layout[] = {
         0xFFFFFFFF,0xEA000000,
         0xFFFFFFFF,0xAA000000,
         0xFFFFFFFE,0xA9000000,
@@ -92,10 +138,14 @@ Reactor::Reactor() {
     // Generate graphite stack layout
     for (int i=0;i<reactor_width;i++) {
         for (int j=0;j<reactor_width;j++) {
-            auto &c = columns[i][j];
+            // assigned explicitly, GCC 12 drops default member
+            // initializers of arrays in constant initializers
+            l.rods[i][j] = make_rod(RodType::None);
+            auto &c = l.columns[i][j];
             c = ColumnType::RR;
-            int i0 = floor(abs(i-reactor_width/2+0.5)); // 0-27
-            int j0 = floor(abs(j-reactor_width/2+0.5)); // 0-27
+            // distance to the center, 0-27
+            int i0 = (i >= reactor_width/2)?i-reactor_width/2:reactor_width/2-1-i;
+            int j0 = (j >= reactor_width/2)?j-reactor_width/2:reactor_width/2-1-j;
             if (i0<=16 && j0<=16) {
                 c = ColumnType::FC_CPS;
             } else if (i0>19 && j0>19) {
@@ -103,7 +153,7 @@ Reactor::Reactor() {
             } else {
                 int i1 = min(i0,j0); // 0-19
                 int j1 = max(i0,j0); // 17-27
-                int cell = layout[(j1-17)*2+i1/16];
+                uint32_t cell = stack_layout[(j1-17)*2+i1/16];
                 int val = (cell >> ((15-(i1%16))*2)) & 0x3;
                 if (val == 1) c = ColumnType::RRC;
                 else if (val == 2) c = ColumnType::RR;
@@ -112,7 +162,7 @@ Reactor::Reactor() {
             }
         }
     }
-    map<int, RodType> rod_decode = {{1, RodType::Manual}, {2, RodType::Short}, {3, RodType::Automatic}, {4, RodType::Source}};
+    const RodType rod_decode[] = {RodType::None, RodType::Manual, RodType::Short, RodType::Automatic, RodType::Source};
 
     // Generate CPS layout, scram all control rods and withdraw sources
     for (int i=0;i<17;i++) {
@@ -122,7 +172,7 @@ Reactor::Reactor() {
                 int x[] = {11+i*2+j*2, 11+i*2-j*2};
                 int y[] = {11+i*2-j*2, 11+i*2+j*2};
                 for (int k=0;k<2;k++) {
-                    rods[x[k]][y[k]] = Rod(rod_decode[val]);
+                    l.rods[x[k]][y[k]] = make_rod(rod_decode[val]);
                 }
             }
         }
@@ -131,110 +181,114 @@ Reactor::Reactor() {
     // Generate Fuel layout, withdraw all outside the core
     for (int i=4;i<reactor_width-4;i++) {
         for (int j=4;j<reactor_width-4;j++) {
-            if (columns[i][j] == ColumnType::FC_CPS &&
-                rods[i][j].type == RodType::None)
-                    rods[i][j] = Rod(RodType::Fuel);
+            if (l.columns[i][j] == ColumnType::FC_CPS &&
+                l.rods[i][j].type == RodType::None)
+                    l.rods[i][j] = make_rod(RodType::Fuel);
         }
     }
+    return l;
+}
 
-    // Initialize neutron flux
-    for (int i=0;i<reactor_width;i++) {
-        for (int j=0;j<reactor_width;j++) {
-            for (int k=0;k<reactor_height;k++) {
-                neutron_flux[i][j][k] = 0;
-            }
-        }
-    }
+constexpr CoreLayout core_layout = make_layout();
 
-    // Generate groups (outwards to inwards)
-    groups.push_back({
-        {18,2},{22,2},{26,2},{30,2},{36,4},{38,6},{40,8},{42,10},{44,12},
-        {46,18},{46,22},{46,26},{46,30},{46,34},{44,36},{42,38},{40,40},{38,42},{36,44},
-        {34,46},{30,46},{26,46},{22,46},{18,46},{12,44},{10,42},{8,40},{6,38},{4,36},
-        {2,30},{2,26},{2,22},{2,18},{4,12},{6,10},{8,8},{10,6},{12,4},
-    });
-    groups.push_back({
-        {16,4},{20,4},{24,4},{28,4},{32,4},
-        {34,6},{36,8},{38,10},{40,12},{42,14},{44,16},
-        {44,20},{44,24},{44,28},{44,32},
-        {42,34},{40,36},{38,38},{36,40},{34,42},{32,44},
-        {28,44},{24,44},{20,44},{16,44},
-        {14,42},{12,40},{10,38},{8,36},{6,34},{4,32},
-        {4,28},{4,24},{4,20},{4,16},
-        {6,14},{8,12},{10,10},{12,8},{14,6}
-    });
+// Rod groups (outwards to inwards)
 
-    groups.push_back({
-        {18,6},{22,6},{26,6},{30,6},
-        {34,10},{36,12},{38,14},
-        {42,18},{42,22},{42,26},{42,30},
-        {38,34},{36,36},{34,38},
-        {30,42},{26,42},{22,42},{18,42},
-        {14,38},{12,36},{10,34},
-        {6,30},{6,26},{6,22},{6,18},
-        {10,14},{12,12},{14,10},
-    });
+constexpr pair<int,int> group_1[] = {
+    {18,2},{22,2},{26,2},{30,2},{36,4},{38,6},{40,8},{42,10},{44,12},
+    {46,18},{46,22},{46,26},{46,30},{46,34},{44,36},{42,38},{40,40},{38,42},{36,44},
+    {34,46},{30,46},{26,46},{22,46},{18,46},{12,44},{10,42},{8,40},{6,38},{4,36},
+    {2,30},{2,26},{2,22},{2,18},{4,12},{6,10},{8,8},{10,6},{12,4}
+};
 
-    groups.push_back({
-        {20,8},{24,8},{28,8},
-        {30,10},{32,12},{34,14},{36,16},{38,18},
-        {40,20},{40,24},{40,28},
-        {38,30},{36,32},{34,34},{32,36},{30,38},
-        {28,40},{24,40},{20,40},
-        {18,38},{16,36},{14,34},{12,32},{10,30},
-        {8,28},{8,24},{8,20},
-        {10,18},{12,16},{14,14},{16,12},{18,10},
-        {22,10},{26,10},{38,22},{38,26},
-        {22,38},{26,38},{10,22},{10,26}
-    });
+constexpr pair<int,int> group_2[] = {
+    {16,4},{20,4},{24,4},{28,4},{32,4},
+    {34,6},{36,8},{38,10},{40,12},{42,14},{44,16},
+    {44,20},{44,24},{44,28},{44,32},
+    {42,34},{40,36},{38,38},{36,40},{34,42},{32,44},
+    {28,44},{24,44},{20,44},{16,44},
+    {14,42},{12,40},{10,38},{8,36},{6,34},{4,32},
+    {4,28},{4,24},{4,20},{4,16},
+    {6,14},{8,12},{10,10},{12,8},{14,6}
+};
 
-    groups.push_back({
-        {20,12},{22,14},{26,14},{28,12},
-        {30,14},{34,18},
-        {36,20},{34,22},{34,26},{36,28},
-        {34,30},{30,34},
-        {28,36},{26,34},{22,34},{20,36},
-        {18,34},{14,30},
-        {12,28},{14,26},{14,22},{12,20},
-        {14,18},{18,14}
-    });
+constexpr pair<int,int> group_3[] = {
+    {18,6},{22,6},{26,6},{30,6},
+    {34,10},{36,12},{38,14},
+    {42,18},{42,22},{42,26},{42,30},
+    {38,34},{36,36},{34,38},
+    {30,42},{26,42},{22,42},{18,42},
+    {14,38},{12,36},{10,34},
+    {6,30},{6,26},{6,22},{6,18},
+    {10,14},{12,12},{14,10}
+};
 
-    groups.push_back({
-        {16,20},{18,18},{20,16},
-        {28,32},{30,30},{32,28},
-        {28,16},{30,18},{32,20},
-        {16,28},{18,30},{20,32},
-        {18,22},{30,22},{18,26},{30,26},
-        {22,18},{22,30},{26,18},{26,30},
-    });
+constexpr pair<int,int> group_4[] = {
+    {20,8},{24,8},{28,8},
+    {30,10},{32,12},{34,14},{36,16},{38,18},
+    {40,20},{40,24},{40,28},
+    {38,30},{36,32},{34,34},{32,36},{30,38},
+    {28,40},{24,40},{20,40},
+    {18,38},{16,36},{14,34},{12,32},{10,30},
+    {8,28},{8,24},{8,20},
+    {10,18},{12,16},{14,14},{16,12},{18,10},
+    {22,10},{26,10},{38,22},{38,26},
+    {22,38},{26,38},{10,22},{10,26}
+};
 
-    groups.push_back({
-        {20,20},{22,22},{24,24},{26,26},{28,28},
-        {28,20},{26,22},{22,26},{20,28}
-    });
+constexpr pair<int,int> group_5[] = {
+    {20,12},{22,14},{26,14},{28,12},
+    {30,14},{34,18},
+    {36,20},{34,22},{34,26},{36,28},
+    {34,30},{30,34},
+    {28,36},{26,34},{22,34},{20,36},
+    {18,34},{14,30},
+    {12,28},{14,26},{14,22},{12,20},
+    {14,18},{18,14}
+};
 
-    // source layout
+constexpr pair<int,int> group_6[] = {
+    {16,20},{18,18},{20,16},
+    {28,32},{30,30},{32,28},
+    {28,16},{30,18},{32,20},
+    {16,28},{18,30},{20,32},
+    {18,22},{30,22},{18,26},{30,26},
+    {22,18},{22,30},{26,18},{26,30}
+};
 
-    center_sources = {
-        {27,19},
-        {27,35},
-        {19,27},
-        {35,27}
-    };
+constexpr pair<int,int> group_7[] = {
+    {20,20},{22,22},{24,24},{26,26},{28,28},
+    {28,20},{26,22},{22,26},{20,28}
+};
 
+struct RodGroup {
+    const pair<int,int> *channels;
+    int size;
+
+    constexpr const pair<int,int> *begin() const {return channels;}
+    constexpr const pair<int,int> *end() const {return channels+size;}
+};
+
+constexpr RodGroup groups[] = {
+    {group_1, (int)size(group_1)},
+    {group_2, (int)size(group_2)},
+    {group_3, (int)size(group_3)},
+    {group_4, (int)size(group_4)},
+    {group_5, (int)size(group_5)},
+    {group_6, (int)size(group_6)},
+    {group_7, (int)size(group_7)},
+};
+static_assert(size(groups) == Reactor::group_count, "group_count does not match the group table");
 
-    outer_sources = {
-        {19,11},
-        {35,11},
-        {19,43},
-        {35,43},
-        {11,19},
-        {11,35},
-        {43,19},
-        {43,35}
-    };
 }
 
+const Reactor::ColumnType (&Reactor::columns)[Reactor::reactor_width][Reactor::reactor_width] = core_layout.columns;
+const Reactor::Rod (&Reactor::initial_rods)[Reactor::reactor_width][Reactor::reactor_width] = core_layout.rods;
+
+Reactor::Reactor(bool huge_pages): flux_field(huge_pages), mesh_field(huge_pages) {
+    copy(&initial_rods[0][0], &initial_rods[0][0]+reactor_width*reactor_width, &rods[0][0]);
+    flux_field.resize(reactor_width*reactor_width*axial_sections);
+    flux_field.set_slots(1);
+}
 
 bool Reactor::select_rod(int x, int y) {
     if (scrammed) return true;
@@ -261,7 +315,7 @@ void Reactor::select_all() {
 
 void Reactor::select_group(int g) {
     if (scrammed) return;
-    if (g < 1 || g> (int)groups.size()) return;
+    if (g < 1 || g > group_count) return;
     unselect_all();
     for (auto r : groups[g-1]) {
         rods[r.first+3][r.second+3].selected = true;
@@ -324,11 +378,39 @@ void Reactor::step(float dt) {
                 r.pos_z = min(r.target_z, r.pos_z + rod_insert_speed*dt);
         }
     }
-    // Neutron flux computation
-    const float prompt_gen_time = 0.002;
+    // Neutron flux computation, optimized kernels fold the telemetry
+    // reductions into their last sweep
+    const bool reduce = telemetry_time >= telemetry_dt;
+    step_generations = ceil(dt/prompt_gen_time);
+    step_sweeps = step_generations;
+    step_substeps = step_generations;
+    step_largest = min(step_generations, 1);
+    switch (kernel) {
+    case Kernel::Reference:
+        flux_reference(dt);
+        if (reduce) reduce_rows(0, reactor_width);
+        break;
+    case Kernel::Optimized:
+        flux_optimized(dt, false, reduce);
+        break;
+    case Kernel::Threaded:
+        flux_optimized(dt, true, reduce);
+        break;
+    case Kernel::MultiResolution:
+        flux_multires(dt, reduce);
+        break;
+    }
 
+    telemetry(dt);
+}
+
+// Original scalar loop, kept untouched as the ground truth for validation
+void Reactor::flux_reference(float dt) {
+    using Field = float[reactor_width][reactor_width][axial_sections];
+    flux_field.set_slots(Sources+1);
+    auto &neutron_flux = *reinterpret_cast<Field*>(flux_field.slot(Current));
     // double buffer for diffusion
-    float db_neutron_flux[reactor_width][reactor_width][axial_sections];
+    auto &db_neutron_flux = *reinterpret_cast<Field*>(flux_field.slot(Sources));
 
     for (int it = 0;it<(dt/prompt_gen_time);it++) {
         // sources and sinks
@@ -396,35 +478,602 @@ void Reactor::step(float dt) {
             }
         }
     }
-    // telemetry
+}
 
-    if (telemetry_time >= telemetry_dt) {
-        // Neutron total
-        total_neutron_flux = 0;
+// Multiplication and source of a cell spanning [z0, z0+hz], for hz = graphite_width
+// this is the same arithmetic as the reference loop
+static void cell_coefficients(const Reactor::Rod &r, Reactor::ColumnType c, float z0, float hz, float &gain, float &source) {
+    using RodType = Reactor::RodType;
+    using ColumnType = Reactor::ColumnType;
 
-        for (int i = 0; i < reactor_width; ++i) {
+    float nn = 0;
+    float constant_source = 0;
+    if (c == ColumnType::FC_CPS) {
+        float bound_min_z = z0;
+        if (r.type == RodType::Source) {
+            const float source_length = 7;
+            const float source_bound_min = max(0.f, min(r.pos_z-bound_min_z, hz));
+            const float source_bound_max = max(0.f, min(r.pos_z-bound_min_z+source_length, hz));
+            const float source_content = (source_bound_max-source_bound_min)/hz;
+            // the source strength is given per graphite block
+            constant_source = source_content*source_strength*(hz/graphite_width);
+        } else if (r.type == RodType::Manual || r.type == RodType::Automatic || r.type == RodType::Short) {
+            const float abs_length = (r.type == RodType::Short)?short_absorber_length:absorber_length;
+            const float boron_bound_min = max(0.f,min(r.pos_z-bound_min_z,hz));
+            const float boron_bound_max = max(0.f,min(r.pos_z+abs_length-bound_min_z,hz));
+
+            const float boron_content = (boron_bound_max-boron_bound_min)/hz;
+
+            nn -= boron_content*b4c_volume*b4c_abs_mcs;
+            nn -= (1-boron_content)*b4c_volume*water_abs_mcs;
+        } else if (r.type == RodType::Fuel) {
+            // no fuel in the bottom two graphite blocks
+            const float fuel_content = max(0.f, min(bound_min_z+hz-2*graphite_width, hz))/hz;
+            if (fuel_content > 0) {
+                const float u235_fission = enrichment*u235_fission_mcs;
+                const float u235_capture = enrichment*u235_abs_mcs;
+                const float u238_capture = (1-enrichment)*u238_abs_mcs;
+
+                nn += u_volume*(u235_fission*(u235_neutrons-1)-u235_capture-u238_capture)*fuel_content;
+            }
+        }
+        nn -= coolant_volume*water_abs_mcs;
+        nn -= graphite_volume*graphite_abs_mcs;
+    } else if (c == ColumnType::RR) {
+        nn -= rr_graphite_volume*graphite_abs_mcs;
+    } else if (c == ColumnType::RRC) {
+        nn -= graphite_volume*graphite_abs_mcs;
+        nn -= rrc_coolant_volume*water_abs_mcs;
+    }
+    gain = 1+max(nn, -1.f);
+    source = constant_source;
+}
+
+// Same sweeps as the reference, with the rod-dependent coefficients computed
+// once per step instead of once per generation, and branch-free diffusion
+void Reactor::flux_optimized(float dt, bool threaded, bool reduce) {
+    const int n_cells = reactor_width*reactor_width*axial_sections;
+    flux_gain.resize(n_cells);
+    flux_source.resize(n_cells);
+
+    auto rows = [&](const function<void(int,int)> &f) {
+        if (threaded) parallel_for(reactor_width, f);
+        else f(0, reactor_width);
+    };
+
+    rows([&](int i0, int i1) {
+        for (int i = i0; i < i1; ++i) {
+            for (int j = 0; j < reactor_width; ++j) {
+                const int c = (i*reactor_width+j)*axial_sections;
+                for (int k=0;k<axial_sections;k++) {
+                    cell_coefficients(rods[i][j], columns[i][j], k*graphite_width, graphite_width, flux_gain[c+k], flux_source[c+k]);
+                }
+            }
+        }
+    });
+
+    const bool adaptive = step_tolerance > 0;
+    flux_field.set_slots(adaptive?Older+1:Sources+1);
+    // cells far below the peak only count against this floor
+    float flux_floor = max(flux_peak*1E-6f, numeric_limits<float>::min());
+
+    const float coef = 1.0/9.0;
+    const float zero[axial_sections] = {};
+    float *buf_0 = flux_field.slot(Sources);
+    const float *gain = flux_gain.data();
+    const float *source = flux_source.data();
+
+    auto column = [&](int i, int j) -> const float* {
+        if (i < 0 || i >= reactor_width || j < 0 || j >= reactor_width) return zero;
+        return buf_0+(i*reactor_width+j)*axial_sections;
+    };
+
+    // One generation. Adaptive sub-stepping diffuses it into the Older slot
+    // and rotates the slots so that it becomes the Current one, otherwise it
+    // replaces the Current slot. With moments its change is compared with
+    // the two previous ones.
+    auto sweep = [&](bool moments, bool reduce_now) {
+        const float *flux = flux_field.slot(Current);
+        const float *prev = adaptive?flux_field.slot(Previous):nullptr;
+        const float *older = adaptive?flux_field.slot(Older):nullptr;
+        float *next = flux_field.slot(adaptive?Older:Current);
+
+        // sources and sinks
+        rows([&](int i0, int i1) {
+            const int c0 = i0*reactor_width*axial_sections;
+            const int c1 = i1*reactor_width*axial_sections;
+            for (int c=c0;c<c1;c++) buf_0[c] = flux[c]*gain[c]+source[c];
+        });
+
+        // diffuse flux
+        rows([&](int i0, int i1) {
+            for (int i = i0; i < i1; ++i) {
+                if (reduce_now) reduce_row(i);
+                double m[moment_count] = {};
+                // the oldest generation is read before it is overwritten
+                float diffused[axial_sections];
+                for (int j = 0; j < reactor_width; ++j) {
+                    const float *b = column(i, j);
+                    const float *b2 = column(i-1, j);
+                    const float *b3 = column(i, j-1);
+                    const float *b5 = column(i+1, j);
+                    const float *b6 = column(i, j+1);
+                    const int c = (i*reactor_width+j)*axial_sections;
+                    float *out = moments?diffused:next+c;
+
+                    const int top = axial_sections-1;
+                    out[0] = b[0]*coef + (0+b2[0]+b3[0]+b[1]+b5[0]+b6[0])*(1-coef)/6;
+                    for (int k=1;k<top;k++) {
+                        out[k] = b[k]*coef + (b[k-1]+b2[k]+b3[k]+b[k+1]+b5[k]+b6[k])*(1-coef)/6;
+                    }
+                    out[top] = b[top]*coef + (b[top-1]+b2[top]+b3[top]+0+b5[top]+b6[top])*(1-coef)/6;
+
+                    if (moments) {
+                        for (int k=0;k<axial_sections;k++) {
+                            // changes relative to the cell's own flux
+                            const double scale = abs(out[k])+flux_floor;
+                            const double d2 = (out[k]-flux[c+k])/scale;
+                            const double d1 = (flux[c+k]-prev[c+k])/scale;
+                            const double d0 = (prev[c+k]-older[c+k])/scale;
+                            m[0] += d2*d1;
+                            m[1] += d2*d0;
+                            m[2] += d1*d1;
+                            m[3] += d1*d0;
+                            m[4] += d0*d0;
+                            m[5] += d2*d2;
+                            m[6] = max(m[6], (double)abs(out[k]));
+                        }
+                        copy(out, out+axial_sections, next+c);
+                        out = next+c;
+                    }
+                    if (reduce_now) reduce_column(i, j, out);
+                }
+                copy(m, m+moment_count, row_moments[i]);
+            }
+        });
+        if (adaptive) {
+            flux_field.swap(Older, Previous);
+            flux_field.swap(Previous, Current);
+        }
+    };
+
+    // Generations the last change can be carried over, assuming it follows
+    // the recurrence fitted on the last changes : d2 = a.d1 + b.d0, the
+    // slowest mode and the odd-even one diffusion leaves behind, or a
+    // single ratio (b = 0) right after an extrapolation. What does not
+    // follow the fit is the error estimate, it adds up as m(m+1)/2 over m
+    // generations and is held against the change it extrapolates. Both are
+    // RMS over the cells of changes relative to each cell's flux, so that
+    // cells away from the peak count as much as the peak. Flux at rest is
+    // only resolved down to float rounding.
+    auto extrapolation = [&](int left, bool recurrence, float &alpha, float &beta) -> int {
+        double m[moment_count] = {};
+        for (int i=0;i<reactor_width;i++) {
+            for (int l=0;l<moment_count-1;l++) m[l] += row_moments[i][l];
+            m[6] = max(m[6], row_moments[i][6]);
+        }
+        flux_peak = m[6];
+        flux_floor = max(flux_peak*1E-6f, numeric_limits<float>::min());
+        double a = (m[2] > 0)?m[0]/m[2]:0, b = 0;
+        const double det = m[2]*m[4]-m[3]*m[3];
+        if (recurrence && det > 1E-9*m[2]*m[4]) {
+            const double a2 = (m[0]*m[4]-m[1]*m[3])/det;
+            const double b2 = (m[1]*m[2]-m[0]*m[3])/det;
+            // the second mode may alternate (the odd-even mode of the stencil
+            // decays by -7/9) but not grow that way
+            const double disc = a2*a2+4*b2;
+            if (disc >= 0 && a2-sqrt(disc) > -2) {
+                a = a2;
+                b = b2;
+            }
+        }
+        const double error = sqrt(max(0.0, m[5]-a*m[0]-b*m[1])/n_cells);
+        const double change = sqrt(m[5]/n_cells);
+        const double rest = numeric_limits<float>::epsilon();
+
+        int g = 0;
+        while (g < left && error*(g+1)*(g+2)/2 <= step_tolerance*change*(g+1)+rest) g++;
+
+        // sum of the next g changes, as a combination of the last two
+        double u0 = 0, v0 = 1, u1 = 1, v1 = 0, su = 0, sv = 0;
+        for (int it=0;it<g;it++) {
+            const double u2 = a*u1+b*u0, v2 = a*v1+b*v0;
+            su += u2;
+            sv += v2;
+            u0 = u1; v0 = v1;
+            u1 = u2; v1 = v2;
+        }
+        alpha = su;
+        beta = sv;
+        return g;
+    };
+
+    auto extrapolate = [&](float alpha, float beta, bool reduce_now) {
+        float *flux = flux_field.slot(Current);
+        const float *prev = flux_field.slot(Previous);
+        const float *older = flux_field.slot(Older);
+        rows([&](int i0, int i1) {
+            for (int i = i0; i < i1; ++i) {
+                if (reduce_now) reduce_row(i);
+                for (int j = 0; j < reactor_width; ++j) {
+                    const int c = (i*reactor_width+j)*axial_sections;
+                    float *n = flux+c;
+                    for (int k=0;k<axial_sections;k++) {
+                        n[k] += (n[k]-prev[c+k])*alpha+(prev[c+k]-older[c+k])*beta;
+                    }
+                    if (reduce_now) reduce_column(i, j, n);
+                }
+            }
+        });
+    };
+
+    const int generations = step_generations;
+    step_sweeps = 0;
+    step_substeps = 0;
+    step_largest = 0;
+    int done = 0;
+    // sweeps since the last extrapolation, the fit carries over from the
+    // previous step while the slots still hold its last generations
+    int swept = step_swept;
+    while (done < generations) {
+        // left after this sweep, extrapolating a single generation costs
+        // as much as a sweep
+        const int left = generations-done-1;
+        const bool moments = adaptive && left >= 2 && swept > 0;
+        sweep(moments, reduce && left == 0);
+        done++;
+        swept++;
+        step_sweeps++;
+        step_substeps++;
+        step_largest = max(step_largest, 1);
+
+        if (moments) {
+            float alpha, beta;
+            int m = extrapolation(left, swept > 2, alpha, beta);
+            if (m >= 2) {
+                extrapolate(alpha, beta, reduce && done+m == generations);
+                done += m;
+                swept = 0;
+                step_substeps++;
+                step_largest = max(step_largest, m);
+            }
+        }
+    }
+    step_swept = adaptive?swept:0;
+}
+
+struct Reactor::MeshLayout {
+    int offset[reactor_width][reactor_width];
+    int cells[reactor_width][reactor_width];
+    int total = 0;
+    // offsets of the four lateral neighbours of a column, the zero padding
+    // after the last cell when the neighbour is outside the reactor or of a
+    // different height
+    int neighbours[reactor_width][reactor_width][4];
+    // faces between columns of different heights, sorted by row
+    struct Face {
+        int offset, cells; // column receiving the exchange
+        int neighbour, neighbour_cells;
+    };
+    std::vector<Face> faces;
+    int face_rows[reactor_width+1];
+};
+
+// Lays out the multi-resolution mesh and fills it from the uniform field
+void Reactor::mesh_build() {
+    if (!mesh) {
+        auto l = make_shared<MeshLayout>();
+        int total = 0;
+        for (int i=0;i<reactor_width;i++) {
+            for (int j=0;j<reactor_width;j++) {
+                int cells = (columns[i][j] == ColumnType::FC_CPS)?
+                    axial_sections*mesh_refinement:axial_sections/mesh_coarsening;
+                l->offset[i][j] = total;
+                l->cells[i][j] = cells;
+                total += cells;
+            }
+        }
+        l->total = total;
+
+        // neighbours of the same height are read in place, the others are
+        // exchanged with face by face
+        for (int i=0;i<reactor_width;i++) {
+            l->face_rows[i] = l->faces.size();
+            for (int j=0;j<reactor_width;j++) {
+                const int ni[] = {i-1, i+1, i, i};
+                const int nj[] = {j, j, j-1, j+1};
+                for (int d=0;d<4;d++) {
+                    l->neighbours[i][j][d] = total;
+                    if (ni[d] < 0 || ni[d] >= reactor_width || nj[d] < 0 || nj[d] >= reactor_width) continue;
+                    const int o = l->offset[ni[d]][nj[d]];
+                    const int m = l->cells[ni[d]][nj[d]];
+                    if (m == l->cells[i][j]) l->neighbours[i][j][d] = o;
+                    else l->faces.push_back({l->offset[i][j], l->cells[i][j], o, m});
+                }
+            }
+        }
+        l->face_rows[reactor_width] = l->faces.size();
+        mesh = l;
+    }
+    const MeshLayout &l = *mesh;
+    // every slot ends with a column of zeros, never written to
+    mesh_field.resize(l.total+axial_sections*mesh_max_refinement);
+    mesh_field.set_slots(MeshNext+1);
+    mesh_gain.resize(l.total);
+    mesh_source.resize(l.total);
+
+    for (int i=0;i<reactor_width;i++) {
+        for (int j=0;j<reactor_width;j++) {
+            float *m = mesh_field.slot(MeshCurrent)+l.offset[i][j];
+            const float *n = flux_field.slot(Current)+(i*reactor_width+j)*axial_sections;
+            const int cells = l.cells[i][j];
+            if (cells >= axial_sections) {
+                const int r = cells/axial_sections;
+                for (int c=0;c<cells;c++) m[c] = n[c/r]/r;
+            } else {
+                const int r = axial_sections/cells;
+                for (int c=0;c<cells;c++) {
+                    m[c] = 0;
+                    for (int k=c*r;k<(c+1)*r;k++) m[c] += n[k];
+                }
+            }
+        }
+    }
+    mesh_valid = true;
+}
+
+// Flux is kept as a neutron count per cell. Neighbouring cells exchange
+// alpha*(n_b/h_b-n_a/h_a) per generation and unit of shared face height,
+// which conserves neutrons across faces between cells of different heights
+// and reduces to the uniform kernels' stencil on a uniform mesh. Lateral
+// exchange is explicit, axial exchange too unless the column is refined
+// enough to make it unstable, then it is solved implicitly per column.
+void Reactor::flux_multires(float dt, bool reduce) {
+    if (!mesh_valid) mesh_build();
+    flux_field.set_slots(Current+1);
+    const MeshLayout &l = *mesh;
+
+    parallel_for(reactor_width, [&](int i0, int i1) {
+        for (int i = i0; i < i1; ++i) {
+            for (int j = 0; j < reactor_width; ++j) {
+                const int o = l.offset[i][j];
+                const int cells = l.cells[i][j];
+                const float hz = reactor_height/cells;
+                for (int c=0;c<cells;c++) {
+                    cell_coefficients(rods[i][j], columns[i][j], c*hz, hz, mesh_gain[o+c], mesh_source[o+c]);
+                }
+            }
+        }
+    });
+
+    mesh_generations(ceil(dt/prompt_gen_time));
+    mesh_restrict(reduce);
+}
+
+// Generations on the mesh with the coefficients of mesh_gain and mesh_source
+void Reactor::mesh_generations(int generations) {
+    const MeshLayout &l = *mesh;
+    const float alpha = (1-1.0/9.0)/6;
+    const int total = l.total;
+    const float *gain = mesh_gain.data();
+    const float *source = mesh_source.data();
+
+    // Axial exchange only depends on the number of cells in the column. It
+    // is explicit as long as the stencil stays positive, otherwise the
+    // tridiagonal systems are factored once for the core and reflector sizes.
+    // The uniform kernels have zero flux half a graphite block beyond the
+    // top and bottom, refined end cells exchange with that plane by gamma
+    // rather than with a ghost cell of their own height, which would leak
+    // as if the plane were closer. Coarse reflector cells keep the ghost
+    // cell, closer to the reference over the validation transients.
+    const int sizes[] = {axial_sections*mesh_refinement, axial_sections/mesh_coarsening};
+    float beta[2], gamma[2];
+    bool implicit[2];
+    float cp[2][axial_sections*mesh_max_refinement];
+    float inv[2][axial_sections*mesh_max_refinement];
+    for (int s=0;s<2;s++) {
+        const int n = sizes[s];
+        const float ratio = (float)n/axial_sections;
+        beta[s] = alpha*ratio*ratio;
+        gamma[s] = (ratio > 1)?beta[s]*2/(ratio+1):beta[s];
+        implicit[s] = 4*alpha+max(2*beta[s], beta[s]+gamma[s]) > 1;
+        const float diag = 1+2*beta[s];
+        const float end = 1+beta[s]+gamma[s];
+        inv[s][0] = 1/end;
+        cp[s][0] = -beta[s]*inv[s][0];
+        for (int c=1;c<n;c++) {
+            inv[s][c] = 1/(((c == n-1)?end:diag)+beta[s]*cp[s][c-1]);
+            cp[s][c] = -beta[s]*inv[s][c];
+        }
+    }
+
+    for (int it = 0;it<generations;it++) {
+        // sources and sinks
+        const float *flux = mesh_field.slot(MeshCurrent);
+        float *buf_0 = mesh_field.slot(MeshSources);
+        float *next = mesh_field.slot(MeshNext);
+        parallel_for(reactor_width, [&](int i0, int i1) {
+            const int c0 = l.offset[i0][0];
+            const int c1 = (i1 < reactor_width)?l.offset[i1][0]:total;
+            for (int c=c0;c<c1;c++) buf_0[c] = flux[c]*gain[c]+source[c];
+        });
+
+        // diffuse flux
+        parallel_for(reactor_width, [&](int i0, int i1) {
+            for (int i = i0; i < i1; ++i) {
+                // lateral with the neighbours of the same height, and axial
+                // where it is explicit
+                for (int j = 0; j < reactor_width; ++j) {
+                    const int n = l.cells[i][j];
+                    const float *b = buf_0+l.offset[i][j];
+                    const int *nb = l.neighbours[i][j];
+                    const float *q0 = buf_0+nb[0], *q1 = buf_0+nb[1], *q2 = buf_0+nb[2], *q3 = buf_0+nb[3];
+                    float *out = next+l.offset[i][j];
+
+                    const int s = (n == sizes[0])?0:1;
+                    if (implicit[s]) {
+                        for (int c=0;c<n;c++) {
+                            out[c] = b[c]*(1-4*alpha) + (q0[c]+q1[c]+q2[c]+q3[c])*alpha;
+                        }
+                    } else {
+                        const float self = 1-4*alpha-2*beta[s];
+                        const float end = 1-4*alpha-beta[s]-gamma[s];
+                        out[0] = b[0]*end + (q0[0]+q1[0]+q2[0]+q3[0])*alpha + b[1]*beta[s];
+                        for (int c=1;c<n-1;c++) {
+                            out[c] = b[c]*self + (q0[c]+q1[c]+q2[c]+q3[c])*alpha + (b[c-1]+b[c+1])*beta[s];
+                        }
+                        out[n-1] = b[n-1]*end + (q0[n-1]+q1[n-1]+q2[n-1]+q3[n-1])*alpha + b[n-2]*beta[s];
+                    }
+                }
+
+                // lateral across faces between columns of different
+                // heights, neighbour cells summed or shared over ours
+                for (int f = l.face_rows[i]; f < l.face_rows[i+1]; f++) {
+                    const MeshLayout::Face &face = l.faces[f];
+                    float *out = next+face.offset;
+                    const float *nb = buf_0+face.neighbour;
+                    if (face.neighbour_cells > face.cells) {
+                        const int r = face.neighbour_cells/face.cells;
+                        for (int c=0;c<face.cells;c++) {
+                            float sum = 0;
+                            for (int s=0;s<r;s++) sum += nb[c*r+s];
+                            out[c] += sum*alpha;
+                        }
+                    } else {
+                        const int r = face.cells/face.neighbour_cells;
+                        const float share = alpha/r;
+                        for (int c=0;c<face.cells;c++) out[c] += nb[c/r]*share;
+                    }
+                }
+
+                // axial, backward Euler with a tridiagonal solve, batches of
+                // columns of the same size are solved together to overlap
+                // the recurrences
+                const int batch_max = 8;
+                for (int j0 = 0; j0 < reactor_width;) {
+                    const int n = l.cells[i][j0];
+                    const int s = (n == sizes[0])?0:1;
+                    float *x[batch_max];
+                    int batch = 0;
+                    while (batch < batch_max && j0 < reactor_width && l.cells[i][j0] == n) {
+                        x[batch++] = next+l.offset[i][j0++];
+                    }
+                    if (!implicit[s]) continue;
+                    for (int b=0;b<batch;b++) x[b][0] *= inv[s][0];
+                    for (int c=1;c<n;c++) {
+                        for (int b=0;b<batch;b++) x[b][c] = (x[b][c]+beta[s]*x[b][c-1])*inv[s][c];
+                    }
+                    for (int c=n-2;c>=0;c--) {
+                        for (int b=0;b<batch;b++) x[b][c] -= cp[s][c]*x[b][c+1];
+                    }
+                }
+            }
+        });
+        mesh_field.swap(MeshCurrent, MeshNext);
+    }
+}
+
+// Back to the uniform field shown everywhere else
+void Reactor::mesh_restrict(bool reduce) {
+    const MeshLayout &l = *mesh;
+    parallel_for(reactor_width, [&](int i0, int i1) {
+        for (int i = i0; i < i1; ++i) {
+            if (reduce) reduce_row(i);
             for (int j = 0; j < reactor_width; ++j) {
-                if (columns[i][j] == ColumnType::FC_CPS) {
+                const float *m = mesh_field.slot(MeshCurrent)+l.offset[i][j];
+                const int cells = l.cells[i][j];
+                float *n = flux_field.slot(Current)+(i*reactor_width+j)*axial_sections;
+                if (cells >= axial_sections) {
+                    const int r = cells/axial_sections;
                     for (int k=0;k<axial_sections;k++) {
-                        auto &n = neutron_flux[i][j][k];
-                        total_neutron_flux += n;
+                        n[k] = 0;
+                        for (int c=k*r;c<(k+1)*r;c++) n[k] += m[c];
                     }
+                } else {
+                    const int r = axial_sections/cells;
+                    for (int k=0;k<axial_sections;k++) n[k] = m[k/r]/r;
                 }
+                if (reduce) reduce_column(i, j, n);
             }
         }
+    });
+}
+
+void Reactor::mesh_diffuse(int generations) {
+    if (!mesh_valid) mesh_build();
+    fill(mesh_gain.begin(), mesh_gain.end(), 1.f);
+    fill(mesh_source.begin(), mesh_source.end(), 0.f);
+    mesh_generations(generations);
+    mesh_restrict(false);
+}
+
+// Row partials of the telemetry, filled column by column
+void Reactor::reduce_row(int i) {
+    row_flux[i] = 0;
+    for (int k=0;k<axial_sections;k++) row_axial_flux[i][k] = 0;
+    if (i >= core_offset && i < core_offset+core_width) {
+        for (int j=0;j<core_width;j++) channel_flux[i-core_offset][j] = 0;
+    }
+}
+
+void Reactor::reduce_column(int i, int j, const float* n) {
+    if (columns[i][j] != ColumnType::FC_CPS) return;
+    float channel = 0;
+    for (int k=0;k<axial_sections;k++) {
+        channel += n[k];
+        row_axial_flux[i][k] += n[k];
+    }
+    row_flux[i] += channel;
+    channel_flux[i-core_offset][j-core_offset] = channel;
+}
+
+void Reactor::reduce_rows(int i0, int i1) {
+    for (int i=i0;i<i1;i++) {
+        reduce_row(i);
+        const float *flux = flux_field.slot(Current);
+        for (int j=0;j<reactor_width;j++) reduce_column(i, j, flux+(i*reactor_width+j)*axial_sections);
+    }
+}
+
+void Reactor::telemetry(float dt) {
+    if (telemetry_time >= telemetry_dt) {
+        // Neutron total and axial profile
+        total_neutron_flux = 0;
+        for (int k=0;k<axial_sections;k++) axial_flux[k] = 0;
+
+        for (int i = 0; i < reactor_width; ++i) {
+            total_neutron_flux += row_flux[i];
+            for (int k=0;k<axial_sections;k++) axial_flux[k] += row_axial_flux[i][k];
+        }
+
         // get peaks
-        float center_flux = 0;
-        float outer_flux = 0;
+        float axial_max = 0;
+        for (int k=0;k<axial_sections;k++) axial_max = max(axial_max, axial_flux[k]);
+        axial_peak = (total_neutron_flux > 0)?axial_max*axial_sections/total_neutron_flux:0;
 
-        for (int k=0;k<axial_sections;k++) {
-            for (auto p : center_sources) {
-                center_flux += neutron_flux[p.first][p.second][k];
+        float channel_max = 0;
+        float channel_sum = 0;
+        int fuel_channels = 0;
+        for (int i=0;i<core_width;i++) {
+            for (int j=0;j<core_width;j++) {
+                if (rods[i+core_offset][j+core_offset].type == RodType::Fuel) {
+                    channel_max = max(channel_max, channel_flux[i][j]);
+                    channel_sum += channel_flux[i][j];
+                    fuel_channels++;
+                }
             }
-            for (auto p : outer_sources) {
-                outer_flux += neutron_flux[p.first][p.second][k];
+        }
+        radial_peak = (channel_sum > 0)?channel_max*fuel_channels/channel_sum:0;
+
+        // local flux around rod groups
+        for (int g=0;g<group_count;g++) {
+            float sum = 0;
+            for (auto r : groups[g]) {
+                sum += channel_flux[r.first+3-core_offset][r.second+3-core_offset];
             }
+            group_flux[g] = sum/groups[g].size;
         }
-        radial_peak = (outer_sources.size()*center_flux)/(center_sources.size()*outer_flux);
+
         // multiplication per dt
         float change = (total_neutron_flux/previous_flux);
         previous_flux = total_neutron_flux;
@@ -447,10 +1096,95 @@ float Reactor::get_period() {
     return period;
 }
 
+void Reactor::set_kernel(Kernel k) {
+    // the mesh is filled again from the uniform field when switching back
+    if (k != kernel) {
+        mesh_valid = false;
+        mesh.reset();
+        mesh_field.resize(0);
+        step_swept = 0;
+    }
+    kernel = k;
+}
+
+bool Reactor::set_mesh(int refinement, int coarsening) {
+    if (refinement != 1 && refinement != 2 && refinement != 4 && refinement != 8) return false;
+    if (coarsening < 1 || coarsening > 8 || axial_sections%coarsening != 0) return false;
+    mesh_refinement = refinement;
+    mesh_coarsening = coarsening;
+    mesh_valid = false;
+    mesh.reset();
+    return true;
+}
+
+Reactor::Kernel Reactor::get_kernel() {
+    return kernel;
+}
+
+void Reactor::set_tolerance(float tolerance) {
+    step_tolerance = max(tolerance, 0.f);
+    step_swept = 0;
+}
+
+float Reactor::get_tolerance() {
+    return step_tolerance;
+}
+
 float Reactor::get_radial_peak() {
     return radial_peak;
 }
 
+float Reactor::get_axial_peak() {
+    return axial_peak;
+}
+
+float Reactor::get_channel_flux(int x, int y) {
+    if (x < 0 || x >= core_width || y < 0 || y >= core_width) return 0;
+    return channel_flux[x][y];
+}
+
+float Reactor::get_axial_flux(int k) {
+    if (k < 0 || k >= axial_sections) return 0;
+    return axial_flux[k];
+}
+
+float Reactor::get_group_flux(int g) {
+    if (g < 1 || g > group_count) return 0;
+    return group_flux[g-1];
+}
+
+int Reactor::get_group_count() {
+    return group_count;
+}
+
+int Reactor::get_generations() {
+    return step_generations;
+}
+
+int Reactor::get_sweeps() {
+    return step_sweeps;
+}
+
+int Reactor::get_substeps() {
+    return step_substeps;
+}
+
+int Reactor::get_largest_substep() {
+    return step_largest;
+}
+
+const float* Reactor::get_flux_field() const {
+    return flux_field.slot(Current);
+}
+
+void Reactor::load_flux_field(const float* field, float dt) {
+    copy(field, field+reactor_width*reactor_width*axial_sections, flux_field.slot(Current));
+    mesh_valid = false;
+    step_swept = 0;
+    if (telemetry_time >= telemetry_dt) reduce_rows(0, reactor_width);
+    telemetry(dt);
+}
+
 void Reactor::scram() {
     scrammed = true;
 }
@@ -459,27 +1193,4 @@ void Reactor::scram_reset() {
     scrammed = false;
 }
 
-Reactor::Rod::Rod(RodType type): type(type) {
-    if (type == RodType::Source) {
-        min_pos_z = -7;
-        max_pos_z = 0.5;
-        direction = true;
-        pos_z = min_pos_z;
-    } else if (type == RodType::Manual || type == RodType::Automatic) {
-        min_pos_z = -absorber_length+0.5;
-        max_pos_z = 0.5;
-        direction = true;
-        pos_z = max_pos_z;
-    } else if (type == RodType::Short) {
-        min_pos_z = reactor_height-short_absorber_length-0.5;
-        max_pos_z = reactor_height-0.5;
-        direction = false;
-        pos_z = min_pos_z;
-    } else if (type == RodType::Fuel) {
-        min_pos_z = 0;
-        max_pos_z = 0;
-        direction = true;
-        pos_z = 0;
-    }
-    target_z = pos_z;
-}
\ No newline at end of file
+Reactor::Rod::Rod(RodType type): Rod(make_rod(type)) {}
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <memory>
+#include <utility>
 #include <vector>
 
+#include "field.h"
+
 class Reactor {
 public:
     enum class ColumnType {
@@ -32,12 +36,27 @@ public:
         bool selected = false;
     };
 
+    enum class Kernel {
+        Reference, // Original scalar loop, kept as is for validation
+        Optimized, // Coefficients computed once per step
+        Threaded, // Optimized, with rows spread over worker threads
+        MultiResolution // Threaded, on a mesh refined axially in the core and coarsened in the reflector
+    };
+
     constexpr const static int reactor_width = 56;
     constexpr const static int axial_sections = 32;
+    // Fuel and CPS channels all lie within this square
+    constexpr const static int core_offset = 4;
+    constexpr const static int core_width = reactor_width-2*core_offset;
+    constexpr const static int group_count = 7;
 
 private:
     bool scrammed = false;
-    float neutron_flux[reactor_width][reactor_width][axial_sections];
+    // flux field slots : current generation, after sources and sinks (not
+    // used by Kernel::MultiResolution) and the two previous generations
+    // (adaptive sub-stepping only)
+    enum FluxSlot { Current, Sources, Previous, Older };
+    FluxField flux_field;
     float total_neutron_flux = 0;
     float previous_flux = 0;
     float axial_peak = 0;
@@ -47,9 +66,57 @@ private:
     const float telemetry_dt = 0.5;
     float telemetry_time = 0.0;
 
-    std::vector<std::vector<std::pair<int,int>>> groups;
+    // telemetry reductions, per-row partials are combined in row order
+    float row_flux[reactor_width] = {};
+    float row_axial_flux[reactor_width][axial_sections] = {};
+    float channel_flux[core_width][core_width] = {};
+    float axial_flux[axial_sections] = {};
+    float group_flux[group_count] = {};
+
+    Kernel kernel = Kernel::Optimized;
+    // per-cell multiplication and source
+    std::vector<float> flux_gain;
+    std::vector<float> flux_source;
+
+    // adaptive sub-stepping of the optimized kernels, 0 sweeps every generation
+    float step_tolerance = 0;
+    // per-row sums of d2.d1, d2.d0, d1.d1, d1.d0, d0.d0 and d2.d2 over the
+    // last three changes, relative to each cell's flux, and the row's
+    // largest cell over the last sweep
+    constexpr const static int moment_count = 7;
+    double row_moments[reactor_width][moment_count] = {};
+    float flux_peak = 0;
+    int step_swept = 0;
+    int step_generations = 0;
+    int step_sweeps = 0;
+    int step_substeps = 0;
+    int step_largest = 0;
+
+    // multi-resolution mesh, cells of a column stored contiguously from the bottom
+    constexpr const static int mesh_max_refinement = 8;
+    int mesh_refinement = 2; // core cells per graphite block
+    int mesh_coarsening = 2; // graphite blocks per reflector cell
+    bool mesh_valid = false;
+    // allocated by mesh_build while Kernel::MultiResolution is in use,
+    // never changed once built so that copies of the reactor share it
+    struct MeshLayout;
+    std::shared_ptr<const MeshLayout> mesh;
+    enum MeshSlot { MeshCurrent, MeshSources, MeshNext };
+    FluxField mesh_field;
+    std::vector<float> mesh_gain;
+    std::vector<float> mesh_source;
 
     void unselect_all();
+    void flux_reference(float dt);
+    void flux_optimized(float dt, bool threaded, bool reduce);
+    void mesh_build();
+    void flux_multires(float dt, bool reduce);
+    void mesh_generations(int generations);
+    void mesh_restrict(bool reduce);
+    void reduce_row(int i);
+    void reduce_column(int i, int j, const float* n);
+    void reduce_rows(int i0, int i1);
+    void telemetry(float dt);
 
 public:
     void step(float dt);
@@ -63,15 +130,72 @@ public:
     void scram();
     void scram_reset();
 
+    void set_kernel(Kernel k);
+    Kernel get_kernel();
+    // Mesh of Kernel::MultiResolution : refinement of 1, 2, 4 or 8 cells per
+    // graphite block in fuel and CPS channels, coarsening of 1, 2, 4 or 8
+    // blocks per cell elsewhere
+    bool set_mesh(int refinement, int coarsening);
+    // Diffusion alone on that mesh, with unit gain and no sources, over the
+    // current field (conservation checks)
+    void mesh_diffuse(int generations);
+    // Optimized kernels extrapolate over generations while the flux changes
+    // steadily. tolerance bounds the RMS error over the cells against the
+    // RMS extrapolated change, both taken relative to each cell's flux.
+    // 0 (default) sweeps every generation.
+    void set_tolerance(float tolerance);
+    float get_tolerance();
+
     float get_neutron_flux();
     float get_period();
     float get_radial_peak();
+    float get_axial_peak();
+    // Flux integrated over a channel, in core coordinates (0 to core_width-1)
+    float get_channel_flux(int x, int y);
+    float get_axial_flux(int k);
+    // Mean channel flux of a rod group, 1-based as in select_group
+    float get_group_flux(int g);
+    int get_group_count();
+
+    // Sub-steps of the last step : generations advanced, diffusion sweeps
+    // run, sub-steps taken (sweeps and extrapolations) and the largest
+    // sub-step in generations
+    int get_generations();
+    int get_sweeps();
+    int get_substeps();
+    int get_largest_substep();
+
+    // Raw access to the flux field, reactor_width*reactor_width*axial_sections floats
+    const float* get_flux_field() const;
+    // Replace the flux field (e.g. during playback) and update telemetry as if dt elapsed
+    void load_flux_field(const float* field, float dt);
     
-    ColumnType columns[reactor_width][reactor_width];
+    // Graphite stack layout, shared by all reactors
+    static const ColumnType (&columns)[reactor_width][reactor_width];
+    // Rods as every reactor starts with them, their types never change
+    static const Rod (&initial_rods)[reactor_width][reactor_width];
     Rod rods[reactor_width][reactor_width];
 
-    std::vector<std::pair<int,int>> center_sources;
-    std::vector<std::pair<int,int>> outer_sources;
+    // source layout
+    constexpr const static std::pair<int,int> center_sources[] = {
+        {27,19},
+        {27,35},
+        {19,27},
+        {35,27}
+    };
+
+    constexpr const static std::pair<int,int> outer_sources[] = {
+        {19,11},
+        {35,11},
+        {19,43},
+        {35,43},
+        {11,19},
+        {11,35},
+        {43,19},
+        {43,35}
+    };
 
-    Reactor();
+    // Huge pages back the flux fields large enough to fill one, none at the
+    // current grid size
+    explicit Reactor(bool huge_pages = false);
 };
\ No newline at end of file
@@ -0,0 +1,386 @@
+#include "recorder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+const char flux_magic[8] = {'R','B','M','K','F','L','U','X'};
+const uint32_t flux_version = 3;
+
+template <typename T>
+static void put(ostream& out, const T& v) {
+    out.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template <typename T>
+static bool get(istream& in, T& v) {
+    in.read(reinterpret_cast<char*>(&v), sizeof(T));
+    return (bool)in;
+}
+
+// Rods worth recording : everything that moves
+static bool recorded_rod(const Reactor::Rod& r) {
+    return r.type != Reactor::RodType::None && r.type != Reactor::RodType::Fuel;
+}
+
+FluxCodec::FluxCodec(bool log_space, float log_step): log_space(log_space), log_step(log_step) {}
+
+uint16_t FluxCodec::quantize(float v, float scale) const {
+    if (!(v > 0)) return 0;
+    if (log_space) {
+        float l = (log10(v)-log_min)/log_step;
+        if (l < 0) return 0;
+        return 1+(uint16_t)min(65534.f, round(l));
+    }
+    if (scale <= 0) return 0;
+    return (uint16_t)min(65535.f, round(v/scale*65535));
+}
+
+float FluxCodec::dequantize(uint16_t c, float scale) const {
+    if (c == 0) return 0;
+    if (log_space) return pow(10.f, log_min+(c-1)*log_step);
+    return c*scale/65535;
+}
+
+static void put_varint(vector<uint8_t>& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((v&0x7F)|0x80);
+        v >>= 7;
+    }
+    out.push_back(v);
+}
+
+static bool get_varint(const vector<uint8_t>& in, size_t& pos, uint32_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (pos >= in.size()) return false;
+        uint8_t b = in[pos++];
+        v |= (uint32_t)(b&0x7F) << shift;
+        if (!(b&0x80)) return true;
+    }
+    return false;
+}
+
+// Tokens : even = run of (token/2) zeros, odd = zigzagged residual
+void FluxCodec::encode_residuals(const vector<int32_t>& residuals, vector<uint8_t>& out) {
+    out.clear();
+    uint32_t run = 0;
+    for (auto r : residuals) {
+        if (r == 0) {
+            run++;
+            continue;
+        }
+        if (run > 0) put_varint(out, run << 1);
+        run = 0;
+        uint32_t zz = ((uint32_t)r << 1) ^ (uint32_t)(r >> 31);
+        put_varint(out, (zz << 1) | 1);
+    }
+    if (run > 0) put_varint(out, run << 1);
+}
+
+bool FluxCodec::decode_residuals(const vector<uint8_t>& in, vector<int32_t>& residuals) {
+    size_t pos = 0;
+    size_t n = 0;
+    while (pos < in.size()) {
+        uint32_t token;
+        if (!get_varint(in, pos, token)) return false;
+        if (token & 1) {
+            if (n >= residuals.size()) return false;
+            uint32_t zz = token >> 1;
+            residuals[n++] = (int32_t)(zz >> 1) ^ -(int32_t)(zz & 1);
+        } else {
+            uint32_t run = token >> 1;
+            if (n+run > residuals.size()) return false;
+            fill(residuals.begin()+n, residuals.begin()+n+run, 0);
+            n += run;
+        }
+    }
+    return n == residuals.size();
+}
+
+Recorder::Recorder(const string& filename, bool log_space, int keyframe_interval):
+    codec(log_space), keyframe_interval(max(1, keyframe_interval)),
+    file(filename, ios::binary | ios::trunc),
+    codes(FluxCodec::cells), previous_codes(FluxCodec::cells), older_codes(FluxCodec::cells), residuals(FluxCodec::cells) {
+
+    if (!file) return;
+
+    for (int i=0;i<Reactor::reactor_width;i++) {
+        for (int j=0;j<Reactor::reactor_width;j++) {
+            if (recorded_rod(Reactor::initial_rods[i][j])) rod_count++;
+        }
+    }
+
+    file.write(flux_magic, sizeof(flux_magic));
+    put(file, flux_version);
+    put(file, (uint32_t)Reactor::reactor_width);
+    put(file, (uint32_t)Reactor::reactor_width);
+    put(file, (uint32_t)Reactor::axial_sections);
+    put(file, (uint32_t)(log_space?1:0));
+    put(file, (uint32_t)this->keyframe_interval);
+    put(file, rod_count);
+    put(file, FluxCodec::log_min);
+    put(file, codec.log_step);
+    bytes = file.tellp();
+
+    writer = thread(&Recorder::run, this);
+    open = true;
+}
+
+Recorder::~Recorder() {
+    stop();
+}
+
+bool Recorder::is_open() const {
+    return open;
+}
+
+void Recorder::push(const Reactor& reactor, float time) {
+    if (!is_open()) return;
+
+    unique_ptr<Frame> frame;
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        if (stopping) return;
+        if (!pool.empty()) {
+            frame = move(pool.back());
+            pool.pop_back();
+        } else if (allocated < max_frames) {
+            allocated++;
+        } else {
+            // Writer is behind, never wait on it
+            dropped++;
+            return;
+        }
+    }
+    if (!frame) {
+        frame = make_unique<Frame>();
+        frame->flux.resize(FluxCodec::cells);
+        frame->rods.reserve(rod_count);
+    }
+
+    frame->time = time;
+    const float* field = reactor.get_flux_field();
+    copy(field, field+FluxCodec::cells, frame->flux.begin());
+    frame->rods.clear();
+    for (int i=0;i<Reactor::reactor_width;i++) {
+        for (int j=0;j<Reactor::reactor_width;j++) {
+            auto &r = reactor.rods[i][j];
+            if (recorded_rod(r)) frame->rods.push_back(r.pos_z);
+        }
+    }
+
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        queue.push_back(move(frame));
+    }
+    cv.notify_one();
+}
+
+void Recorder::stop() {
+    {
+        lock_guard<mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    cv.notify_one();
+    if (writer.joinable()) writer.join();
+    if (file.is_open()) file.close();
+}
+
+int Recorder::get_frames() const {
+    lock_guard<mutex> lock(queue_mutex);
+    return frames;
+}
+
+int Recorder::get_dropped() const {
+    lock_guard<mutex> lock(queue_mutex);
+    return dropped;
+}
+
+uint64_t Recorder::get_bytes() const {
+    lock_guard<mutex> lock(queue_mutex);
+    return bytes;
+}
+
+void Recorder::run() {
+    while (true) {
+        unique_ptr<Frame> frame;
+        {
+            unique_lock<mutex> lock(queue_mutex);
+            cv.wait(lock, [&]{return stopping || !queue.empty();});
+            if (queue.empty()) break;
+            frame = move(queue.front());
+            queue.pop_front();
+        }
+
+        write(*frame);
+
+        {
+            lock_guard<mutex> lock(queue_mutex);
+            pool.push_back(move(frame));
+            frames++;
+            bytes = file.tellp();
+        }
+    }
+    file.flush();
+}
+
+void Recorder::write(const Frame& frame) {
+    const int nz = Reactor::axial_sections;
+
+    float peak = *max_element(frame.flux.begin(), frame.flux.end());
+
+    // Linear codes are relative to the keyframe scale, start over when it no longer fits
+    bool keyframe = since_keyframe == 0 || since_keyframe >= keyframe_interval;
+    if (!codec.log_space && (peak > scale || peak < scale/1024)) keyframe = true;
+
+    if (keyframe) {
+        since_keyframe = 0;
+        scale = codec.log_space?0:peak*2;
+    }
+
+    for (int n=0;n<FluxCodec::cells;n++) codes[n] = codec.quantize(frame.flux[n], scale);
+
+    // In log space every cell rises or decays at its own steady rate, its
+    // last change is carried over once two frames of the keyframe are known
+    const bool trend = codec.log_space && since_keyframe >= 2;
+    auto predict = [&](int n) -> int32_t {
+        if (!previous_codes[n]) return 0;
+        if (trend && older_codes[n]) return 2*(int32_t)previous_codes[n]-older_codes[n];
+        return previous_codes[n];
+    };
+
+    // what is left of a global rise or decay moves every code by the same amount
+    int32_t shift = 0;
+    if (!keyframe && codec.log_space) {
+        int64_t sum = 0;
+        int count = 0;
+        for (int n=0;n<FluxCodec::cells;n++) {
+            if (codes[n] && previous_codes[n]) {
+                sum += (int32_t)codes[n]-predict(n);
+                count++;
+            }
+        }
+        if (count > 0) shift = (int32_t)llround((double)sum/count);
+    }
+
+    for (int n=0;n<FluxCodec::cells;n++) {
+        if (keyframe) residuals[n] = (int32_t)codes[n]-((n%nz)?codes[n-1]:0);
+        else residuals[n] = (int32_t)codes[n]-(previous_codes[n]?predict(n)+shift:0);
+    }
+    swap(older_codes, previous_codes);
+    swap(codes, previous_codes);
+    FluxCodec::encode_residuals(residuals, payload);
+
+    put(file, (uint8_t)(keyframe?0:1));
+    put(file, frame.time);
+    put(file, scale);
+    put(file, shift);
+    file.write(reinterpret_cast<const char*>(frame.rods.data()), frame.rods.size()*sizeof(float));
+    put(file, (uint32_t)payload.size());
+    file.write(reinterpret_cast<const char*>(payload.data()), payload.size());
+
+    since_keyframe++;
+}
+
+Player::Player(const string& filename):
+    file(filename, ios::binary), codec(false),
+    codes(FluxCodec::cells), previous_codes(FluxCodec::cells), residuals(FluxCodec::cells), flux(FluxCodec::cells) {
+
+    char magic[sizeof(flux_magic)];
+    uint32_t version, nx, ny, nz, flags, keyframe_interval;
+    float log_min, log_step;
+    file.read(magic, sizeof(magic));
+    if (!file || memcmp(magic, flux_magic, sizeof(magic)) != 0 ||
+        !get(file, version) || version != flux_version ||
+        !get(file, nx) || !get(file, ny) || !get(file, nz) ||
+        nx != Reactor::reactor_width || ny != Reactor::reactor_width || nz != Reactor::axial_sections ||
+        !get(file, flags) || !get(file, keyframe_interval) || !get(file, rod_count) ||
+        !get(file, log_min) || !get(file, log_step) ||
+        log_min != FluxCodec::log_min || !(log_step > 0)) {
+        file.close();
+        return;
+    }
+    codec.log_space = flags & 1;
+    codec.log_step = log_step;
+}
+
+bool Player::is_open() const {
+    return file.is_open();
+}
+
+bool Player::next() {
+    if (!is_open()) return false;
+
+    uint8_t type;
+    float frame_time, scale;
+    int32_t shift;
+    if (!get(file, type) || type > 1 || (type == 1 && !started) ||
+        !get(file, frame_time) || !get(file, scale) || !get(file, shift)) return false;
+
+    vector<float> positions(rod_count);
+    file.read(reinterpret_cast<char*>(positions.data()), rod_count*sizeof(float));
+    uint32_t size;
+    if (!file || !get(file, size)) return false;
+    payload.resize(size);
+    file.read(reinterpret_cast<char*>(payload.data()), size);
+    if (!file || !FluxCodec::decode_residuals(payload, residuals)) return false;
+
+    const int nz = Reactor::axial_sections;
+    if (type == 0) since_keyframe = 0;
+    const bool trend = codec.log_space && since_keyframe >= 2;
+    for (int n=0;n<FluxCodec::cells;n++) {
+        const int32_t last = codes[n];
+        if (type == 0) {
+            codes[n] = residuals[n]+((n%nz)?codes[n-1]:0);
+        } else if (last) {
+            const int32_t predicted = (trend && previous_codes[n])?2*last-previous_codes[n]:last;
+            codes[n] = residuals[n]+predicted+shift;
+        } else {
+            codes[n] = residuals[n];
+        }
+        previous_codes[n] = last;
+        flux[n] = codec.dequantize(codes[n], scale);
+    }
+    since_keyframe++;
+
+    size_t p = 0;
+    for (int i=0;i<Reactor::reactor_width;i++) {
+        for (int j=0;j<Reactor::reactor_width;j++) {
+            auto &r = reactor.rods[i][j];
+            if (recorded_rod(r) && p < positions.size()) {
+                r.pos_z = r.target_z = positions[p++];
+            }
+        }
+    }
+
+    reactor.load_flux_field(flux.data(), started?frame_time-time:0);
+    time = frame_time;
+    if (!started) clock = frame_time;
+    started = true;
+    return true;
+}
+
+bool Player::advance(float dt) {
+    if (!is_open()) return false;
+    clock += dt;
+    while (true) {
+        // peek at the next frame's time, then rewind to its start
+        const streampos start = file.tellg();
+        uint8_t type;
+        float frame_time;
+        const bool more = get(file, type) && get(file, frame_time);
+        file.clear();
+        file.seekg(start);
+        if (!more) return false;
+        // frames are due to the nearest step, recorded times carry float rounding
+        if (frame_time >= clock+dt/2) return true;
+        if (!next()) return false;
+    }
+}
+
+float Player::get_time() const {
+    return time;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "reactor.h"
+
+// Flux history file layout (little endian) :
+//
+//   header  : magic "RBMKFLUX", version, width, width, axial sections,
+//             flags, keyframe interval, rod count, log origin, log step
+//   frames  : type (0 = keyframe, 1 = delta), time, linear scale,
+//             log shift, rod positions, payload size, payload
+//
+// Every cell is quantized to a 16-bit code, either linearly against the scale
+// of the last keyframe or logarithmically in fixed fractions of a decade.
+// Keyframes store the difference with the cell below, delta frames the
+// difference with the same cell in the previous frame. In log space that
+// cell's last change is carried over as well, from the second delta frame
+// after a keyframe on, and the average of what is left of the change over
+// the whole field is taken out as a shift. Residuals are written as varints
+// with runs of zeros collapsed, so the still parts of the core cost next to
+// nothing.
+
+class FluxCodec {
+public:
+    constexpr const static int cells = Reactor::reactor_width*Reactor::reactor_width*Reactor::axial_sections;
+    constexpr const static float log_min = -40;
+
+    FluxCodec(bool log_space, float log_step = 1.f/256);
+
+    bool log_space;
+    float log_step; // decades per code
+
+    uint16_t quantize(float v, float scale) const;
+    float dequantize(uint16_t c, float scale) const;
+
+    static void encode_residuals(const std::vector<int32_t>& residuals, std::vector<uint8_t>& out);
+    static bool decode_residuals(const std::vector<uint8_t>& in, std::vector<int32_t>& residuals);
+};
+
+// Streams flux frames to disk on a background thread. push() only copies the
+// field into a pooled buffer, frames are dropped if the writer falls behind.
+class Recorder {
+public:
+    Recorder(const std::string& filename, bool log_space, int keyframe_interval = 40);
+    ~Recorder();
+
+    bool is_open() const;
+    void push(const Reactor& reactor, float time);
+    void stop();
+
+    int get_frames() const;
+    int get_dropped() const;
+    uint64_t get_bytes() const;
+
+private:
+    struct Frame {
+        float time = 0;
+        std::vector<float> flux;
+        std::vector<float> rods;
+    };
+
+    constexpr const static int max_frames = 8;
+
+    void run();
+    void write(const Frame& frame);
+
+    FluxCodec codec;
+    const int keyframe_interval;
+    std::ofstream file;
+    uint32_t rod_count = 0;
+    // set once by the constructor, the stream itself belongs to the writer
+    bool open = false;
+
+    // writer state
+    std::vector<uint16_t> codes;
+    std::vector<uint16_t> previous_codes;
+    std::vector<uint16_t> older_codes;
+    std::vector<int32_t> residuals;
+    std::vector<uint8_t> payload;
+    float scale = 0;
+    int since_keyframe = 0;
+
+    mutable std::mutex queue_mutex;
+    std::condition_variable cv;
+    std::deque<std::unique_ptr<Frame>> queue;
+    std::vector<std::unique_ptr<Frame>> pool;
+    int allocated = 0;
+    bool stopping = false;
+    int frames = 0;
+    int dropped = 0;
+    uint64_t bytes = 0;
+    std::thread writer;
+};
+
+// Reads back a flux history into its own reactor, one frame per call to
+// next(), or as many frames as a span of playback time covers with advance().
+class Player {
+public:
+    Player(const std::string& filename);
+
+    bool is_open() const;
+    bool next();
+    // Moves the playback clock on by dt and loads every frame recorded up to
+    // it, false once the history is exhausted
+    bool advance(float dt);
+    float get_time() const;
+
+    Reactor reactor;
+
+private:
+    std::ifstream file;
+    FluxCodec codec;
+    uint32_t rod_count = 0;
+    std::vector<uint16_t> codes;
+    std::vector<uint16_t> previous_codes;
+    std::vector<int32_t> residuals;
+    std::vector<uint8_t> payload;
+    std::vector<float> flux;
+    int since_keyframe = 0;
+    float time = 0;
+    double clock = 0;
+    bool started = false;
+};
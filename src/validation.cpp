@@ -0,0 +1,381 @@
+#include "validation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include "parallel.h"
+
+using namespace std;
+
+vector<Transient> transient_library() {
+    auto insert_sources = [](Reactor &r) {
+        r.select_sources();
+        r.move_rod(100);
+    };
+    auto pull_all = [](Reactor &r) {
+        r.select_all();
+        r.move_rod(-100);
+    };
+    auto pull_group = [](int g) {
+        return [g](Reactor &r) {
+            r.select_group(g);
+            r.move_rod(-100);
+        };
+    };
+    // coordinates as typed in the UI
+    auto move_single = [](int x, int y, float dp) {
+        return [x, y, dp](Reactor &r) {
+            r.select_rod(x+3, y+3);
+            r.move_rod(dp);
+        };
+    };
+
+    // Selecting rods stops whatever was moving before, sources are left
+    // partially inserted once the rods are pulled
+    return {
+        {"startup from sources", 12, {
+            {0, insert_sources},
+            {1, pull_all}
+        }},
+        {"group withdrawal", 10, {
+            {0, insert_sources},
+            {1, pull_group(7)},
+            {3, pull_group(6)},
+            {5, pull_group(5)},
+            {7, pull_group(4)}
+        }},
+        {"scram", 10, {
+            {0, insert_sources},
+            {1, pull_all},
+            {7, [](Reactor &r) {r.scram();}}
+        }},
+        {"single rod moves", 8, {
+            {0, insert_sources},
+            {1, pull_all},
+            {4, move_single(24, 24, 100)},
+            {5, move_single(20, 28, -1)},
+            {6, move_single(24, 24, -1.5)}
+        }},
+    };
+}
+
+vector<Candidate> candidate_kernels() {
+    const float adaptive = 1E-2;
+    return {
+        {"optimized", Reactor::Kernel::Optimized, {}},
+        {"threaded", Reactor::Kernel::Threaded, {}},
+        // Compared over the coarse reflector cells, above a tenth of the
+        // peak. The coarser axial exchange shows in the low flux cells at
+        // the top and bottom of the core edge, up to 0.5 on the first step.
+        // A refined core changes the discretization itself, it is checked
+        // for convergence instead.
+        {"reflector", Reactor::Kernel::MultiResolution, {0.08, 0.01, 0.01, 0.08}, 1, 2, 0, 0.1},
+        // The step tolerance bounds the RMS error over the cells, held
+        // here against every cell
+        {"adaptive", Reactor::Kernel::Threaded, {adaptive, adaptive, adaptive, adaptive}, 1, 1, adaptive},
+    };
+}
+
+// Relative difference, values below floor only count against floor
+static float relative(float a, float b, float floor) {
+    if (!isfinite(a) || !isfinite(b)) {
+        if (isnan(a) && isnan(b)) return 0;
+        return (a == b)?0:1;
+    }
+    return abs(a-b)/max(max(abs(a), abs(b)), floor);
+}
+
+struct Errors {
+    float max_flux = 0;
+    float mean_flux = 0;
+    float total_flux = 0;
+    float period = 0;
+
+    void worst(const Errors &e) {
+        max_flux = max(max_flux, e.max_flux);
+        mean_flux = max(mean_flux, e.mean_flux);
+        total_flux = max(total_flux, e.total_flux);
+        period = max(period, e.period);
+    }
+
+    bool within(const Tolerance &t) const {
+        return max_flux <= t.max_flux && mean_flux <= t.mean_flux &&
+            total_flux <= t.total_flux && period <= t.period;
+    }
+};
+
+// Coarse reflector cells of Kernel::MultiResolution spread their flux
+// evenly over the blocks they cover, both fields are summed over those
+// blocks before comparing, the projection the mesh is filled with
+static Errors compare(Reactor &reference, Reactor &candidate, const Candidate &c) {
+    const int n = Reactor::reactor_width*Reactor::reactor_width*Reactor::axial_sections;
+    const float *a = reference.get_flux_field();
+    const float *b = candidate.get_flux_field();
+    const int coarsening = (c.kernel == Reactor::Kernel::MultiResolution)?c.mesh_coarsening:1;
+
+    float floor = *max_element(a, a+n)*c.flux_floor;
+
+    Errors e;
+    double sum = 0;
+    int count = 0;
+    for (int i=0;i<Reactor::reactor_width;i++) {
+        for (int j=0;j<Reactor::reactor_width;j++) {
+            const int blocks = (Reactor::columns[i][j] == Reactor::ColumnType::FC_CPS)?1:coarsening;
+            const int o = (i*Reactor::reactor_width+j)*Reactor::axial_sections;
+            for (int k=0;k<Reactor::axial_sections;k+=blocks) {
+                float sa = 0, sb = 0;
+                for (int q=k;q<k+blocks;q++) {
+                    sa += a[o+q];
+                    sb += b[o+q];
+                }
+                if (max(abs(sa), abs(sb)) <= floor*blocks) continue;
+                float r = relative(sa, sb, floor*blocks);
+                e.max_flux = max(e.max_flux, r);
+                sum += r;
+                count++;
+            }
+        }
+    }
+    e.mean_flux = count?sum/count:0;
+    e.total_flux = relative(reference.get_neutron_flux(), candidate.get_neutron_flux(), 1E-30);
+    // periods go to infinity around criticality, compare the inverse instead
+    e.period = relative(1/reference.get_period(), 1/candidate.get_period(), 1E-3);
+    return e;
+}
+
+static void print(ostream &out, const Errors &e) {
+    out << scientific << setprecision(2)
+        << "flux max " << e.max_flux << " mean " << e.mean_flux
+        << ", total " << e.total_flux << ", period " << e.period;
+    out << defaultfloat;
+}
+
+bool validate_conservation(ostream &out) {
+    const int w = Reactor::reactor_width;
+    const int n = w*w*Reactor::axial_sections;
+    // Neutrons only leave through the edges of the reactor. Over a single
+    // generation flux this far from them never reaches them, except through
+    // the implicit axial solve, far below float rounding.
+    const int generations = 1;
+    const int margin = 2;
+    vector<float> field(n);
+    double before = 0;
+    for (int i=margin;i<w-margin;i++) {
+        for (int j=margin;j<w-margin;j++) {
+            for (int k=8;k<Reactor::axial_sections-8;k++) {
+                float v = 1+(i*7+j*13+k*5)%11;
+                field[(i*w+j)*Reactor::axial_sections+k] = v;
+                before += v;
+            }
+        }
+    }
+
+    out << "mesh conservation (one generation, unit gain, no sources)" << endl;
+    bool passed = true;
+    for (int refinement : {1, 2, 4}) {
+        for (int coarsening : {1, 2, 8}) {
+            auto r = make_unique<Reactor>();
+            r->set_kernel(Reactor::Kernel::MultiResolution);
+            r->set_mesh(refinement, coarsening);
+            r->load_flux_field(field.data(), 0);
+            r->mesh_diffuse(generations);
+            const float *f = r->get_flux_field();
+            double after = 0;
+            for (int c=0;c<n;c++) after += f[c];
+
+            float drift = abs(after-before)/before;
+            bool ok = drift <= conservation_tolerance;
+            passed = passed && ok;
+            out << "  mesh " << refinement << " " << coarsening << "   drift "
+                << scientific << setprecision(2) << drift << defaultfloat
+                << (ok?"  PASS":"  FAIL") << endl;
+        }
+    }
+    return passed;
+}
+
+bool validate_convergence(ostream &out, const vector<Transient> &transients, float dt) {
+    out << "mesh convergence (refinement " << convergence_meshes[0];
+    for (int m=1;m<3;m++) out << ", " << convergence_meshes[m];
+    out << ", reflector coarsening 2)" << endl;
+    bool passed = true;
+    for (auto &t : transients) {
+        unique_ptr<Reactor> reactors[3];
+        Candidate meshes[3];
+        for (int m=0;m<3;m++) {
+            reactors[m] = make_unique<Reactor>();
+            reactors[m]->set_kernel(Reactor::Kernel::MultiResolution);
+            reactors[m]->set_mesh(convergence_meshes[m], 2);
+            meshes[m] = {"", Reactor::Kernel::MultiResolution, {}, convergence_meshes[m], 2};
+        }
+        // differences between successive refinements
+        Errors coarse, fine;
+
+        size_t next_event = 0;
+        int steps = (int)round(t.duration/dt);
+        for (int s=0;s<steps;s++) {
+            float time = s*dt;
+            while (next_event < t.events.size() && t.events[next_event].first <= time) {
+                for (auto &r : reactors) t.events[next_event].second(*r);
+                next_event++;
+            }
+            for (auto &r : reactors) r->step(dt);
+            coarse.worst(compare(*reactors[1], *reactors[0], meshes[0]));
+            fine.worst(compare(*reactors[2], *reactors[1], meshes[1]));
+        }
+
+        const float total = coarse.total_flux/fine.total_flux;
+        const float period = coarse.period/fine.period;
+        bool ok = total >= convergence_ratio && period >= convergence_ratio;
+        passed = passed && ok;
+        out << "  " << left << setw(22) << t.name << right << scientific << setprecision(2)
+            << " total " << coarse.total_flux << " to " << fine.total_flux
+            << ", period " << coarse.period << " to " << fine.period
+            << defaultfloat << (ok?"  PASS":"  FAIL") << endl;
+    }
+    return passed;
+}
+
+// Hash of the flux field and every telemetry value, equal only when they
+// are bit for bit
+static uint64_t fingerprint(Reactor &r) {
+    uint64_t h = 14695981039346656037ull;
+    auto add = [&](const void *data, size_t bytes) {
+        const unsigned char *c = static_cast<const unsigned char*>(data);
+        for (size_t i=0;i<bytes;i++) h = (h^c[i])*1099511628211ull;
+    };
+    auto add_float = [&](float v) {add(&v, sizeof(v));};
+    add(r.get_flux_field(), Reactor::reactor_width*Reactor::reactor_width*Reactor::axial_sections*sizeof(float));
+    add_float(r.get_neutron_flux());
+    add_float(r.get_period());
+    add_float(r.get_radial_peak());
+    add_float(r.get_axial_peak());
+    for (int i=0;i<Reactor::core_width;i++) {
+        for (int j=0;j<Reactor::core_width;j++) add_float(r.get_channel_flux(i, j));
+    }
+    for (int k=0;k<Reactor::axial_sections;k++) add_float(r.get_axial_flux(k));
+    for (int g=1;g<=r.get_group_count();g++) add_float(r.get_group_flux(g));
+    const int substeps[] = {r.get_sweeps(), r.get_substeps(), r.get_largest_substep()};
+    add(substeps, sizeof(substeps));
+    return h;
+}
+
+bool validate_threads(ostream &out, const vector<Transient> &transients, float dt) {
+    struct Run {
+        string name;
+        Reactor::Kernel kernel;
+        float step_tolerance;
+    };
+    const Run runs[] = {
+        {"threaded", Reactor::Kernel::Threaded, 0},
+        {"adaptive", Reactor::Kernel::Threaded, 1E-2},
+        {"multires", Reactor::Kernel::MultiResolution, 0},
+    };
+    const int counts[] = {1, 2, 3, 4};
+    const int threads = get_thread_count();
+
+    out << "thread counts (1 to 4, identical fields and telemetry)" << endl;
+    bool passed = true;
+    for (auto &run : runs) {
+        // fingerprints of every step of every transient, per thread count
+        vector<vector<uint64_t>> steps;
+        for (int n : counts) {
+            set_thread_count(n);
+            steps.emplace_back();
+            for (auto &t : transients) {
+                auto r = make_unique<Reactor>();
+                r->set_kernel(run.kernel);
+                r->set_tolerance(run.step_tolerance);
+                size_t next_event = 0;
+                int count = (int)round(t.duration/dt);
+                for (int s=0;s<count;s++) {
+                    float time = s*dt;
+                    while (next_event < t.events.size() && t.events[next_event].first <= time) {
+                        t.events[next_event].second(*r);
+                        next_event++;
+                    }
+                    r->step(dt);
+                    steps.back().push_back(fingerprint(*r));
+                }
+            }
+        }
+
+        out << "  " << left << setw(10) << run.name << right;
+        bool ok = true;
+        for (size_t c=1;c<steps.size() && ok;c++) {
+            auto diff = mismatch(steps[0].begin(), steps[0].end(), steps[c].begin());
+            if (diff.first != steps[0].end()) {
+                out << " differs with " << counts[c] << " threads from step " << diff.first-steps[0].begin();
+                ok = false;
+            }
+        }
+        passed = passed && ok;
+        out << (ok?"  PASS":"  FAIL") << endl;
+    }
+    set_thread_count(threads);
+    return passed;
+}
+
+bool validate(ostream &out, const vector<Transient> &transients, const vector<Candidate> &candidates, float dt, bool verbose) {
+    bool passed = true;
+
+    for (auto &t : transients) {
+        out << t.name << " (" << t.duration << "s)" << endl;
+
+        auto reference = make_unique<Reactor>();
+        reference->set_kernel(Reactor::Kernel::Reference);
+        vector<unique_ptr<Reactor>> reactors;
+        for (auto &c : candidates) {
+            reactors.push_back(make_unique<Reactor>());
+            reactors.back()->set_kernel(c.kernel);
+            reactors.back()->set_mesh(c.mesh_refinement, c.mesh_coarsening);
+            reactors.back()->set_tolerance(c.step_tolerance);
+        }
+        vector<Errors> worst(candidates.size());
+        vector<long> sweeps(candidates.size()), generations(candidates.size());
+
+        size_t next_event = 0;
+        int steps = (int)round(t.duration/dt);
+        for (int s=0;s<steps;s++) {
+            float time = s*dt;
+            while (next_event < t.events.size() && t.events[next_event].first <= time) {
+                auto &action = t.events[next_event].second;
+                action(*reference);
+                for (auto &r : reactors) action(*r);
+                next_event++;
+            }
+
+            reference->step(dt);
+            for (size_t c=0;c<candidates.size();c++) {
+                reactors[c]->step(dt);
+                sweeps[c] += reactors[c]->get_sweeps();
+                generations[c] += reactors[c]->get_generations();
+                Errors e = compare(*reference, *reactors[c], candidates[c]);
+                worst[c].worst(e);
+                if (verbose) {
+                    out << "  " << fixed << setprecision(3) << time+dt << "s " << candidates[c].name << " : ";
+                    print(out, e);
+                    out << endl;
+                }
+            }
+        }
+
+        for (size_t c=0;c<candidates.size();c++) {
+            bool ok = worst[c].within(candidates[c].tolerance);
+            passed = passed && ok;
+            out << "  " << left << setw(10) << candidates[c].name << right << " ";
+            print(out, worst[c]);
+            if (candidates[c].step_tolerance > 0) {
+                out << ", swept " << fixed << setprecision(0) << 100.0*sweeps[c]/generations[c] << "%" << defaultfloat;
+            }
+            out << (ok?"  PASS":"  FAIL") << endl;
+        }
+    }
+
+    out << (passed?"All kernels within tolerances":"Tolerances exceeded") << endl;
+    return passed;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "reactor.h"
+
+// Differential validation of the flux kernels against Kernel::Reference.
+// Every kernel runs the same scripted transients side by side with the
+// reference, relative errors are measured after each step.
+
+struct Tolerance {
+    float max_flux = 1E-4; // worst relative error of a single cell
+    float mean_flux = 1E-5; // relative error averaged over the cells
+    float total_flux = 1E-4;
+    float period = 1E-3; // relative error of the inverse period
+};
+
+struct Transient {
+    std::string name;
+    float duration;
+    // (time, action) pairs, sorted by time
+    std::vector<std::pair<float, std::function<void(Reactor&)>>> events;
+};
+
+struct Candidate {
+    std::string name;
+    Reactor::Kernel kernel;
+    Tolerance tolerance;
+    // only used by Kernel::MultiResolution
+    int mesh_refinement = 1;
+    int mesh_coarsening = 1;
+    // Reactor::set_tolerance, only used by the optimized kernels
+    float step_tolerance = 0;
+    // cells below this fraction of the reference peak are not compared
+    float flux_floor = 1E-6;
+};
+
+std::vector<Transient> transient_library();
+std::vector<Candidate> candidate_kernels();
+
+// Relative change of the neutron count allowed over the conservation check
+constexpr const float conservation_tolerance = 1E-5;
+
+// Runs the multi-resolution diffusion alone on refined and coarsened meshes
+// and checks that it keeps the neutron count, returns true when it does
+bool validate_conservation(std::ostream &out);
+
+// Refinements of the convergence check, and the factor by which the
+// differences between successive ones must shrink
+constexpr const int convergence_meshes[] = {2, 4, 8};
+constexpr const float convergence_ratio = 1.5;
+
+// Runs the transients on the multi-resolution mesh refined further and
+// further, and checks that total flux and period converge, returns true
+// when they do
+bool validate_convergence(std::ostream &out, const std::vector<Transient> &transients, float dt);
+
+// Runs the transients on the threaded kernels, plain and adaptive, and on
+// the multi-resolution one with 1 to 4 worker threads, returns true when
+// every thread count gives the same fields and telemetry at every step
+bool validate_threads(std::ostream &out, const std::vector<Transient> &transients, float dt);
+
+// Returns true when every candidate stays within its tolerances
+bool validate(std::ostream &out, const std::vector<Transient> &transients, const std::vector<Candidate> &candidates, float dt, bool verbose = false);